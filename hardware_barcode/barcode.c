@@ -22,411 +22,536 @@
 #include "hardware/i2c.h"
 
 #include "hardware/adc.h"
+#include "hardware/dma.h"
 #include "hardware/gpio.h"
 #include "hardware/barcode.h"
+#include "hardware/barcode_decoder.h"
+#include "hardware/barcode_trace.h"
+#include "hardware/encoder.h"
+#include "hardware/threshold.h"
 
-// Variables to store individual characters of the barcode
-uint8_t barcodeFirstChar=0;
-uint8_t barcodeSecondChar=0;
-uint8_t barcodeThirdChar=0;
-
-// Enum for representing different types of barcode elements
-enum bartype {
-    THICK_BLACK, // 0
-    THIN_BLACK, // 1
-    THICK_WHITE, // 2
-    THIN_WHITE // 3
-};
-
-// Array mappings for Code 39 barcode characters
-static char* A_ARRAY_MAP = "031312130";
-static char* B_ARRAY_MAP = "130312130";
-static char* C_ARRAY_MAP = "030312131";
-static char* D_ARRAY_MAP = "131302130";
-static char* E_ARRAY_MAP = "031302131";
-static char* F_ARRAY_MAP = "130302131";
-static char* G_ARRAY_MAP = "131312030";
-static char* H_ARRAY_MAP = "031312031";
-static char* I_ARRAY_MAP = "130312031";
-static char* J_ARRAY_MAP = "131302031";
-static char* K_ARRAY_MAP = "031313120";
-static char* L_ARRAY_MAP = "130313120";
-static char* M_ARRAY_MAP = "030313121";
-static char* N_ARRAY_MAP = "131303120";
-static char* O_ARRAY_MAP = "031303121";
-static char* P_ARRAY_MAP = "130303121";
-static char* Q_ARRAY_MAP = "131313020";
-static char* R_ARRAY_MAP = "031313021";
-static char* S_ARRAY_MAP = "130313021";
-static char* T_ARRAY_MAP = "131303021";
-static char* U_ARRAY_MAP = "021313130";
-static char* V_ARRAY_MAP = "120313130";
-static char* W_ARRAY_MAP = "020313131";
-static char* X_ARRAY_MAP = "121303130";
-static char* Y_ARRAY_MAP = "021303131";
-static char* Z_ARRAY_MAP = "120303131";
-
-//code 39 format of asterisk using enum bartype.
-static char* ASTERISK_ARRAY_MAP = "121303031";
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
 
 // Variables to hold sensor readings and barcode detection state
 static uint32_t res = 0;
-static uint16_t prevAvg = 0;
 static int i = 0 ;
-static int barcode_arr_index = 1;
+
+// Adaptive black/white threshold of the barcode ADC channel
+static threshold_t barcodeThreshold;
 char* outputBuffer;
-static absolute_time_t blockStart;
-static absolute_time_t blockEnd;
-volatile char read_char;
-
-// Structure to classify voltage readings from the barcode
-struct voltageClassification {
-    uint16_t voltage;
-    // 0 - white
-    // 1 - black
-    int blackWhite;
-    absolute_time_t blockStart;
-    int64_t  blockLength;
-    enum bartype type;
+
+// Interrupt counter and the rate derived from it once per second by the decode task
+static volatile uint32_t barcodeIrqCount = 0;
+static volatile uint32_t barcodeIrqRate = 0;
+static uint32_t lastIrqCount = 0;
+static absolute_time_t lastIrqRateTime;
+
+// Longest time spent in a capture interrupt handler, in microseconds
+static volatile uint32_t barcodeIsrMaxUs = 0;
+
+// Task that decodes edges, woken by a task notification
+static TaskHandle_t decodeTask = NULL;
+
+// Colour transition seen by the capture side: the new colour and when it started
+struct barEdge {
+    uint8_t colour;
+    absolute_time_t time;
 };
 
-// Queue for voltageclassifications of length 9.
-static struct voltageClassification voltageClassifications[BARCODE_BUF_SIZE];
+// Lock-free single-producer single-consumer queue of edges. The producer (ADC IRQ,
+// or the decode task itself in DMA mode) only writes edgeHead, the consumer only
+// writes edgeTail; both are free-running counters masked to the queue size.
+static struct barEdge edgeQueue[BARCODE_EDGE_QUEUE_SIZE];
+static volatile uint32_t edgeHead = 0;
+static volatile uint32_t edgeTail = 0;
+static volatile uint32_t edgeOverflows = 0;
+static uint32_t edgeOverflowsSeen = 0;
+
+// Colour of the last reading, tracked by the producer for edge detection
+static int edgeColour = -1;
+
+#if BARCODE_CAPTURE_MODE == BARCODE_CAPTURE_DMA
+// Double-buffered DMA capture of raw ADC samples
+static uint16_t captureBuffers[2][BARCODE_DMA_BLOCK_SAMPLES];
+static absolute_time_t captureBufferEnd[2];
+static int captureChannels[2];
+static volatile uint32_t blocksCaptured = 0;
+static uint32_t blocksProcessed = 0;
+static uint32_t blocksDropped = 0;
+#endif
+
+// Edge-to-payload decoder, only used by the decode task
+static barcode_decoder_t decoder;
+
+// One bounded event queue per subscriber; each subscriber sees every payload
+static QueueHandle_t subscriberQueues[BARCODE_MAX_SUBSCRIBERS];
+static volatile uint32_t droppedEvents[BARCODE_MAX_SUBSCRIBERS];
+static volatile int subscriberCount = 0;
+
+#if BARCODE_TRACE_ENABLED
+// Trace of readings being recorded: header followed by the records
+static uint8_t traceBuffer[BARCODE_TRACE_HEADER_SIZE + BARCODE_TRACE_RECORDS * BARCODE_TRACE_RECORD_SIZE];
+static volatile uint32_t traceCount = 0;   // Records so far; the trace is printed once full
+static uint64_t traceStartUs;
+static uint64_t traceLastUs;
+static uint32_t traceLastStamp;
+
+// Low-priority task that prints full traces, so printing never holds up decoding
+static TaskHandle_t traceTask = NULL;
+#endif
+
+#if BARCODE_CAPTURE_MODE == BARCODE_CAPTURE_DMA
+// Configure one half of the DMA ping-pong pair, chained to the other half
+static void configureCaptureChannel(int index) {
+    dma_channel_config config = dma_channel_get_default_config(captureChannels[index]);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    channel_config_set_chain_to(&config, captureChannels[index ^ 1]);
+
+    dma_channel_configure(captureChannels[index], &config, captureBuffers[index],
+                          &adc_hw->fifo, BARCODE_DMA_BLOCK_SAMPLES, false);
+    dma_channel_set_irq1_enabled(captureChannels[index], true);
+}
+#endif
+
+// Setup function for barcode reading
+void barcode_setup() {
+    barcode_decoder_init(&decoder);
+    threshold_init(&barcodeThreshold, BARCODE_WHITE_LEVEL, BARCODE_BLACK_LEVEL, BARCODE_THRESHOLD_DECAY_SHIFT);
+    decodeTask = xTaskGetCurrentTaskHandle();
+
+    adc_gpio_init(ADC_PIN);
+    adc_select_input(0);
+    adc_set_clkdiv(0);
+
+#if BARCODE_CAPTURE_MODE == BARCODE_CAPTURE_DMA
+    // DMA moves every sample out of the FIFO; the CPU only hears about full blocks
+    adc_fifo_setup(true, true, 1, false, false);
 
-// Queue for barcode read of length 3.
-static char barcodeRead[3];
+    captureChannels[0] = dma_claim_unused_channel(true);
+    captureChannels[1] = dma_claim_unused_channel(true);
+    configureCaptureChannel(0);
+    configureCaptureChannel(1);
 
-// Function to append to barcodeRead Queue.
-static void appendToBarcodeRead(char barcodeChar) {
-    barcodeRead[0] = barcodeRead[1];
-    barcodeRead[1] = barcodeRead[2];
-    barcodeRead[2] = barcodeChar;
+    irq_add_shared_handler(DMA_IRQ_1, DMA_IRQ_CAPTURE_HANDLER, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    dma_channel_start(captureChannels[0]);
+#else
+    adc_fifo_setup(true, false, 1, false, false);
+    adc_irq_set_enabled(true);
+
+    irq_clear(ADC_IRQ_FIFO);
+    irq_set_exclusive_handler(ADC_IRQ_FIFO, ADC_IRQ_FIFO_HANDLER);
+    irq_set_enabled(ADC_IRQ_FIFO, true);
+#endif
+    
+    adc_run(true);
+
+    lastIrqRateTime = get_absolute_time();
 }
 
-// Check if the current barcode read is valid
-static int isValidBarcode() {
-    if (barcodeRead[0] == '*' && barcodeRead[2] == '*') {
-        if(barcodeRead[1] != 0) {
-            return 1;
-        }
+// Register a new consumer of barcode events. Returns its subscriber number, or -1
+// if BARCODE_MAX_SUBSCRIBERS are already registered.
+int barcode_subscribe() {
+    QueueHandle_t queue = xQueueCreate(BARCODE_EVENT_QUEUE_DEPTH, sizeof(barcode_event_t));
+
+    if (queue == NULL) {
+        return -1;
     }
 
-    return 0;
-}
+    taskENTER_CRITICAL();
+    int subscriber = subscriberCount;
 
-// Check if the barcode read queue is full
-static int isBarcodeFull() {
-    if (barcodeRead[0] != 0 && barcodeRead[1] != 0 && barcodeRead[2] != 0) {
-        return 1;
+    if (subscriber < BARCODE_MAX_SUBSCRIBERS) {
+        subscriberQueues[subscriber] = queue;
+        droppedEvents[subscriber] = 0;
+        subscriberCount = subscriber + 1;
     }
+    taskEXIT_CRITICAL();
 
-    return 0;
+    if (subscriber >= BARCODE_MAX_SUBSCRIBERS) {
+        vQueueDelete(queue);
+        return -1;
+    }
+
+    return subscriber;
 }
 
-// Clear the barcode read queue
-static void clearBarcodeRead() {
-    barcodeRead[0] = 0;
-    barcodeRead[1] = 0;
-    barcodeRead[2] = 0;
+// Wait up to timeout ticks (0 to poll) for the subscriber's next barcode event.
+// Returns 1 if event was filled in.
+int barcode_get_event(int subscriber, barcode_event_t *event, uint32_t timeout) {
+    if (subscriber < 0 || subscriber >= subscriberCount) {
+        return 0;
+    }
+
+    return xQueueReceive(subscriberQueues[subscriber], event, timeout) == pdTRUE;
 }
 
-// Function to convert array of integer to string
-static char *intArrayToString(int *arr, int size) {
-    char *str = malloc(size + 1);
-    
-    for (int i = 0; i < size; i++) {
-        str[i] = arr[i] + '0';
+// Get how many events a subscriber lost because its queue was full
+uint32_t barcode_get_dropped_events(int subscriber) {
+    if (subscriber < 0 || subscriber >= subscriberCount) {
+        return 0;
     }
 
-    str[size] = '\0';
+    return droppedEvents[subscriber];
+}
+
+// Post the payload just decoded to every subscriber. A subscriber whose queue is
+// full loses its oldest event, so it always catches up to the newest ones.
+static void publishPayload(absolute_time_t time) {
+    barcode_event_t event;
+    uint64_t time_us = to_us_since_boot(time);
+
+    memcpy(event.payload, decoder.lastPayload, sizeof(event.payload));
+    event.confidence = decoder.lastPayloadConfidence;
+    event.time_us = time_us;
+    // The sensor sits between the wheels, so use the mean of both wheel positions
+    event.position = (getLeftPositionAt(time_us) + getRightPositionAt(time_us)) / 2;
+
+    for (int subscriber = 0; subscriber < subscriberCount; subscriber++) {
+        QueueHandle_t queue = subscriberQueues[subscriber];
+
+        if (xQueueSend(queue, &event, 0) != pdTRUE) {
+            barcode_event_t oldest;
+            xQueueReceive(queue, &oldest, 0);
+            xQueueSend(queue, &event, 0);
+            droppedEvents[subscriber]++;
+        }
+    }
+}
 
-    return str;
+// Get the live white/black levels and switching points of the barcode sensor
+void barcode_get_threshold_levels(threshold_levels_t *levels) {
+    threshold_get_levels(&barcodeThreshold, levels);
 }
 
-// Function to flush queue
-static void flushVoltageClassification() {
-    barcode_arr_index = 1;
-    blockStart = get_absolute_time();
+// Get the number of codes rejected because their check character did not match
+uint32_t barcode_get_checksum_failures() {
+    return decoder.checksumFailures;
+}
 
-    struct voltageClassification lastReading = voltageClassifications[BARCODE_BUF_SIZE - 1];
+// Place an edge time in the width domain the elements are measured in
+static uint32_t edgeStamp(absolute_time_t time) {
+#if BARCODE_WIDTH_DOMAIN == BARCODE_WIDTH_DISTANCE
+    // The sensor sits between the wheels, so use the mean of both wheel positions
+    uint64_t time_us = to_us_since_boot(time);
+    return (getLeftPositionAt(time_us) + getRightPositionAt(time_us)) / 2;
+#else
+    // 32-bit microseconds; the subtraction for a width is still correct across a wrap
+    return (uint32_t)to_us_since_boot(time);
+#endif
+}
 
-    for (int i = 0; i < BARCODE_BUF_SIZE; i++) {
-        voltageClassifications[i].voltage = 0;
-        voltageClassifications[i].blackWhite = -1;
-        voltageClassifications[i].blockLength = 0;
-        voltageClassifications[i].type = 0;
+#if BARCODE_TRACE_ENABLED
+// Store a little-endian 16-bit trace field
+static void putTraceField(uint8_t *field, uint32_t value) {
+    if (value > BARCODE_TRACE_DELTA_MAX) {
+        value = BARCODE_TRACE_DELTA_MAX;
     }
 
-    voltageClassifications[0] = lastReading;
+    field[0] = value & 0xFF;
+    field[1] = value >> 8;
 }
 
-// Setup function for barcode reading
-void barcode_setup() {
-    flushVoltageClassification();
+// Store a little-endian 32-bit trace field
+static void putTraceWord(uint8_t *field, uint32_t value) {
+    putTraceField(field, value & 0xFFFF);
+    putTraceField(field + 2, value >> 16);
+}
 
-    adc_gpio_init(ADC_PIN);
-    adc_select_input(0);
-    adc_fifo_setup(true, false, 1, false, false);
-    adc_set_clkdiv(0);
-    adc_irq_set_enabled(true);
+// Append one reading to the trace unless it is full and waiting to be printed
+static void traceReading(uint16_t reading, int digital, absolute_time_t time) {
+    uint32_t count = traceCount;
 
-    irq_clear(ADC_IRQ_FIFO);
-    irq_set_exclusive_handler(ADC_IRQ_FIFO, ADC_IRQ_FIFO_HANDLER);
-    irq_set_enabled(ADC_IRQ_FIFO, true);
-    
-    adc_run(true);
+    if (count >= BARCODE_TRACE_RECORDS) {
+        return;
+    }
 
-    blockStart = get_absolute_time();
-}
+    uint64_t time_us = to_us_since_boot(time);
+    uint32_t stamp = edgeStamp(time);
 
-// Classify barcode elements as thick or thin
-static int* thickThinClassification() {
-    //calculate average block length
-    int64_t totalBarLength = 0;
-    for (int i = 0; i< BARCODE_ARR_SIZE; i++) {
-        totalBarLength += voltageClassifications[i].blockLength;
+    if (count == 0) {
+        traceStartUs = time_us;
+        traceLastUs = time_us;
+        traceLastStamp = stamp;
     }
 
-    int *barsRead = malloc(BARCODE_ARR_SIZE * sizeof(int));
+    uint8_t *record = &traceBuffer[BARCODE_TRACE_HEADER_SIZE + count * BARCODE_TRACE_RECORD_SIZE];
+    putTraceField(record, (reading & BARCODE_TRACE_READING_MASK) | (digital ? BARCODE_TRACE_DIGITAL_BIT : 0));
+    putTraceField(record + 2, time_us - traceLastUs);
+#if BARCODE_WIDTH_DOMAIN == BARCODE_WIDTH_DISTANCE
+    putTraceField(record + 4, stamp - traceLastStamp);
+#endif
 
-    int64_t avgBarLength = (totalBarLength/BARCODE_ARR_SIZE);
+    traceLastUs = time_us;
+    traceLastStamp = stamp;
 
-    //assign thick thin classification
-    for(int i = 0; i< BARCODE_ARR_SIZE; i++){
-        if (voltageClassifications[i].blackWhite){
-            if(voltageClassifications[i].blockLength < avgBarLength) {
-                voltageClassifications[i].type = THIN_BLACK;
-            }
-            else {
-                voltageClassifications[i].type = THICK_BLACK;
-            }
-        }
-        else {
-            if (voltageClassifications[i].blockLength < avgBarLength) {
-                voltageClassifications[i].type = THIN_WHITE;
-            }
-            else {
-                voltageClassifications[i].type = THICK_WHITE;
-            }
+    // Publish the record only after it is fully written
+    __compiler_memory_barrier();
+    traceCount = count + 1;
+}
+
+// Print a full trace as hex lines for tools/barcode_replay, then record the next one.
+// Readings are not recorded while the trace is full, so the buffer is not touched
+// until traceCount is cleared.
+static void dumpTrace() {
+    memcpy(traceBuffer, BARCODE_TRACE_MAGIC, 4);
+    traceBuffer[4] = BARCODE_TRACE_VERSION;
+    traceBuffer[5] = BARCODE_WIDTH_DOMAIN;
+    putTraceField(&traceBuffer[6], BARCODE_TRACE_RECORD_SIZE);
+    putTraceWord(&traceBuffer[8], BARCODE_TRACE_RECORDS);
+    putTraceWord(&traceBuffer[12], (uint32_t)traceStartUs);
+
+    printf("%s\n", BARCODE_TRACE_BEGIN);
+
+    for (uint32_t offset = 0; offset < sizeof(traceBuffer); offset += BARCODE_TRACE_LINE_BYTES) {
+        for (uint32_t k = offset; k < offset + BARCODE_TRACE_LINE_BYTES && k < sizeof(traceBuffer); k++) {
+            printf("%02x", traceBuffer[k]);
         }
-        barsRead[i] = voltageClassifications[i].type;
+        printf("\n");
     }
-    //printf("\n\r");
-    return barsRead;
+
+    printf("%s\n", BARCODE_TRACE_END);
+
+    traceCount = 0;
 }
 
-// Function to check if queue is full
-static int isVoltageClassificationFull() {
-    for (int i = 0; i < BARCODE_BUF_SIZE; i++) {
-        if (voltageClassifications[i].blackWhite == -1) {
-            return 0;
+// Trace printing task. Create it at a priority below the decode task's
+// (BARCODE_TRACE_TASK_PRIORITY); it wakes when a trace is full and prints it while
+// the decode task keeps running.
+void barcode_trace_task(void *params) {
+    traceTask = xTaskGetCurrentTaskHandle();
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (traceCount >= BARCODE_TRACE_RECORDS) {
+            dumpTrace();
         }
     }
-    return 1;
 }
+#endif
+
+// Threshold one averaged ADC reading taken at sampleTime and queue an edge when the
+// colour changes. Returns 1 if an edge was queued.
+static int detectEdge(uint16_t avg, absolute_time_t sampleTime) {
+    int digital = gpio_get(DIGITAL_PIN);
+
+#if BARCODE_TRACE_ENABLED
+    traceReading(avg, digital, sampleTime);
+#endif
 
-// Function to compare buffer and the barcodes
-static char compareTwoArray () {
-    int* barsRead = thickThinClassification();
+    int colour = barcode_classify(&barcodeThreshold, avg, digital);
 
-    if (voltageClassifications[0].blackWhite == 0) {
+    if (colour == edgeColour) {
         return 0;
     }
 
-    char* string = intArrayToString(barsRead, BARCODE_ARR_SIZE);
-    free(barsRead);
-
-    char* barcodes[] = {
-        A_ARRAY_MAP,
-        B_ARRAY_MAP,
-        C_ARRAY_MAP,
-        D_ARRAY_MAP,
-        E_ARRAY_MAP,
-        F_ARRAY_MAP,
-        G_ARRAY_MAP,
-        H_ARRAY_MAP,
-        I_ARRAY_MAP,
-        J_ARRAY_MAP,
-        K_ARRAY_MAP,
-        L_ARRAY_MAP,
-        M_ARRAY_MAP,
-        N_ARRAY_MAP,
-        O_ARRAY_MAP,
-        P_ARRAY_MAP,
-        Q_ARRAY_MAP,
-        R_ARRAY_MAP,
-        S_ARRAY_MAP,
-        T_ARRAY_MAP,
-        U_ARRAY_MAP,
-        V_ARRAY_MAP,
-        W_ARRAY_MAP,
-        X_ARRAY_MAP,
-        Y_ARRAY_MAP,
-        Z_ARRAY_MAP,
-        ASTERISK_ARRAY_MAP   
-    };
+    edgeColour = colour;
 
-    
-    char characters[] = {
-        'A',
-        'B',
-        'C',
-        'D',
-        'E',
-        'F',
-        'G',
-        'H',
-        'I',
-        'J',
-        'K',
-        'L',
-        'M',
-        'N',
-        'O',
-        'P',
-        'Q',
-        'R',
-        'S',
-        'T',
-        'U',
-        'V',
-        'W',
-        'X',
-        'Y',
-        'Z',
-        '*'
-    };
-     
+    if (edgeHead - edgeTail >= BARCODE_EDGE_QUEUE_SIZE) {
+        // Consumer is behind; the decode task restarts from the next edge
+        edgeOverflows++;
+        return 0;
+    }
 
-    
-    for (int i = 0; i < 27; i++) {
-        if (strncmp(barcodes[i], string, BARCODE_ARR_SIZE) == 0) {
-            free(string);
-            flushVoltageClassification();
+    struct barEdge *edge = &edgeQueue[edgeHead & BARCODE_EDGE_QUEUE_MASK];
+    edge->colour = colour;
+    edge->time = sampleTime;
 
-            return characters[i];
+    // Publish the entry only after it is fully written
+    __compiler_memory_barrier();
+    edgeHead++;
+
+    return 1;
+}
+
+// Turn queued edges into finished bar elements and decode them
+static void drainEdges() {
+    if (edgeOverflows != edgeOverflowsSeen) {
+        // Edges were lost, so the widths around the gap are meaningless
+        edgeOverflowsSeen = edgeOverflows;
+        barcode_decoder_flush(&decoder);
+    }
+
+    while (edgeTail != edgeHead) {
+        struct barEdge edge = edgeQueue[edgeTail & BARCODE_EDGE_QUEUE_MASK];
+
+        // Hand the slot back only after it has been read
+        __compiler_memory_barrier();
+        edgeTail++;
+
+        if (barcode_decoder_edge(&decoder, edge.colour, edgeStamp(edge.time)) & BARCODE_DECODED_PAYLOAD) {
+            publishPayload(edge.time);
         }
     }
+}
 
-    return 0;
+// Record how long a capture interrupt handler ran since start. tools/barcode_isr_bench
+// times the handler that decoded in the interrupt against the current one.
+static void recordIsrTime(uint32_t start) {
+    uint32_t elapsed = time_us_32() - start;
+
+    if (elapsed > barcodeIsrMaxUs) {
+        barcodeIsrMaxUs = elapsed;
+    }
 }
 
+#if BARCODE_CAPTURE_MODE == BARCODE_CAPTURE_DMA
+// DMA IRQ handler, runs once per filled capture block
+static void DMA_IRQ_CAPTURE_HANDLER() {
+    uint32_t start = time_us_32();
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
 
-// Function to append queue
-static void appendVoltageClassification(struct voltageClassification voltageClassification) {
-    voltageClassifications[0] = voltageClassifications[1];
-    voltageClassifications[1] = voltageClassifications[2];
-    voltageClassifications[2] = voltageClassifications[3];
-    voltageClassifications[3] = voltageClassifications[4];
-    voltageClassifications[4] = voltageClassifications[5];
-    voltageClassifications[5] = voltageClassifications[6];
-    voltageClassifications[6] = voltageClassifications[7];
-    voltageClassifications[7] = voltageClassifications[8];
-    voltageClassifications[8] = voltageClassifications[9];
-    voltageClassifications[9] = voltageClassification;
-    
-    if (barcode_arr_index == BARCODE_BUF_SIZE) {
-        char read = compareTwoArray();
+    for (int index = 0; index < 2; index++) {
+        if (dma_channel_get_irq1_status(captureChannels[index])) {
+            dma_channel_acknowledge_irq1(captureChannels[index]);
+            barcodeIrqCount++;
 
-        if (read != 0) {
-            read_char = read;
-            printf("%c\0", read);
+            // The other channel is already running; re-arm this one for its next turn
+            captureBufferEnd[index] = get_absolute_time();
+            dma_channel_set_write_addr(captureChannels[index], captureBuffers[index], false);
+            blocksCaptured++;
 
-            appendToBarcodeRead(read);
+            if (decodeTask != NULL) {
+                vTaskNotifyGiveFromISR(decodeTask, &higherPriorityTaskWoken);
+            }
         }
     }
-}
 
-// Get the last read barcode character
-char getBarcodeChar() {
-    return read_char;
+    recordIsrTime(start);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
 
-// ADC IRQ handler for reading barcode data
+// Decimate every captured block that has not been processed yet into edges
+static void processCapturedBlocks() {
+    uint32_t captured = blocksCaptured;
+
+    // Once a block completes, the chained channel refills the other buffer, so
+    // only the newest completed block is safe to read; older ones are skipped
+    if (captured - blocksProcessed > 1) {
+        blocksDropped += captured - blocksProcessed - 1;
+        blocksProcessed = captured - 1;
+
+        // The element under the sensor spans the gap, so its width is unknown;
+        // restart from the next edge rather than decode a bogus width
+        barcode_decoder_flush(&decoder);
+    }
+
+    while (blocksProcessed != captured) {
+        // Channel 0 always fills the even blocks, channel 1 the odd ones
+        int index = blocksProcessed & 1;
+        const uint16_t *samples = captureBuffers[index];
+        absolute_time_t end = captureBufferEnd[index];
+
+        for (int start = 0; start < BARCODE_DMA_BLOCK_SAMPLES; start += BARCODE_DECIMATION) {
+            uint32_t sum = 0;
+
+            for (int k = 0; k < BARCODE_DECIMATION; k++) {
+                sum += samples[start + k];
+            }
+
+            // Time stamp the reading at its last sample, counting back from block end
+            uint64_t samplesAfter = BARCODE_DMA_BLOCK_SAMPLES - (start + BARCODE_DECIMATION);
+            detectEdge(sum / BARCODE_DECIMATION, from_us_since_boot(to_us_since_boot(end) - samplesAfter * BARCODE_ADC_SAMPLE_US));
+        }
+
+        blocksProcessed++;
+    }
+}
+#else
+// ADC IRQ handler for reading barcode data. Only averages and detects edges;
+// decoding happens in the decode task.
 static void ADC_IRQ_FIFO_HANDLER() {
+    uint32_t start = time_us_32();
+    barcodeIrqCount++;
+
     // read data from ADC FIFO
     if (!adc_fifo_is_empty()) {
         uint16_t data = adc_fifo_get();
         res += data;
        
-        if (i < 100) {
+        if (i < BARCODE_DECIMATION) {
             i++;
         }
         else {
             uint16_t avg = res/ (i);
 
-            if (prevAvg == 0) {
-                prevAvg = avg;
-            }
-            else {
-                if (abs(prevAvg - avg) > ADC_DIFFERENCE_THRESHHOLD) {
-                    prevAvg = avg;
-                }
-                else {
-                    avg = prevAvg;
-                }
-            }
-            
             i = 0;
             res = 0;
 
-            struct voltageClassification voltageClassification;
-            voltageClassification.voltage = avg;
-            
-            if (avg > BLACK_THRESHOLD || gpio_get(DIGITAL_PIN) == 1) {
-                voltageClassification.blackWhite = 1;
-            }
-            else {
-                voltageClassification.blackWhite = 0;
-            }
-
-            if (barcode_arr_index == BARCODE_BUF_SIZE) {
-                if (voltageClassifications[BARCODE_BUF_SIZE - 1].blackWhite != voltageClassification.blackWhite) {
-                    blockEnd = get_absolute_time();
-                    voltageClassification.blockStart = blockEnd;
-                    int64_t blockLength = absolute_time_diff_us(voltageClassifications[BARCODE_BUF_SIZE - 1].blockStart, blockEnd);
-                    voltageClassifications[BARCODE_BUF_SIZE - 1].blockLength =  blockLength / 10000;
-                    appendVoltageClassification(voltageClassification);
-                }
-            }
-            else {
-                if (voltageClassifications[barcode_arr_index-1].blackWhite != voltageClassification.blackWhite) {
-                    blockEnd = get_absolute_time();
-                    voltageClassification.blockStart = blockEnd;
-
-                    if (barcode_arr_index == 0) {
-                        int64_t blockLength = absolute_time_diff_us(blockStart,blockEnd);
-                        voltageClassification.blockLength =  blockLength / 10000;
-                    }
-                    else {
-                        int64_t blockLength = absolute_time_diff_us(voltageClassifications[barcode_arr_index-1].blockStart, blockEnd);
-                        voltageClassifications[barcode_arr_index - 1].blockLength =  blockLength / 10000;
-                    }
-                    
-                    voltageClassifications[barcode_arr_index] = voltageClassification;
-                    barcode_arr_index++;
-                }
+            if (detectEdge(avg, get_absolute_time()) && decodeTask != NULL) {
+                BaseType_t higherPriorityTaskWoken = pdFALSE;
+                vTaskNotifyGiveFromISR(decodeTask, &higherPriorityTaskWoken);
+                irq_clear(ADC_IRQ_FIFO);
+                recordIsrTime(start);
+                portYIELD_FROM_ISR(higherPriorityTaskWoken);
+                return;
             }
         }
     }
     irq_clear(ADC_IRQ_FIFO);
+    recordIsrTime(start);
+}
+#endif
+
+// Update the interrupts-per-second metric once a second has passed. Only the decode
+// task calls this; the count is scaled by the time actually elapsed, as the task
+// can wake a little late.
+static void updateIrqRate() {
+    absolute_time_t now = get_absolute_time();
+    int64_t elapsed = absolute_time_diff_us(lastIrqRateTime, now);
+
+    if (elapsed >= 1000000) {
+        uint32_t count = barcodeIrqCount;
+        barcodeIrqRate = (uint32_t)((uint64_t)(count - lastIrqCount) * 1000000 / elapsed);
+        lastIrqCount = count;
+        lastIrqRateTime = now;
+    }
+}
+
+// Get the number of barcode capture interrupts per second, over the last second
+uint32_t barcode_get_irq_rate() {
+    return barcodeIrqRate;
 }
 
-// Main loop for processing barcode data
-void barcode_main_loop() {
-    //i2c_write_byte('I');
-    if (isValidBarcode()) {
-        printf("Valid Barcode\n\r");
-        barcodeFirstChar = barcodeRead[0];
-        barcodeSecondChar = barcodeRead[1];
-        barcodeThirdChar = barcodeRead[2];
-        printf("Barcode: %c%c%c\n\r", barcodeFirstChar, barcodeSecondChar, barcodeThirdChar);
-        //sendBarcodeVal(); To send barcode values to comms
-        clearBarcodeRead();
-        barcodeFirstChar = 0;
-        barcodeSecondChar = 0;
-        barcodeThirdChar = 0;
+// Get the number of DMA capture blocks skipped because the decode task fell behind
+uint32_t barcode_get_dropped_blocks() {
+#if BARCODE_CAPTURE_MODE == BARCODE_CAPTURE_DMA
+    return blocksDropped;
+#else
+    return 0;
+#endif
+}
+
+// Get the longest time spent in a barcode capture interrupt handler, in microseconds
+uint32_t barcode_get_isr_max_us() {
+    return barcodeIsrMaxUs;
+}
+
+// Block up to timeout ticks until the capture side has new data, then decode it.
+// Waits at most a second, so the IRQ rate stays current with no data coming in.
+void barcode_process_samples(uint32_t timeout) {
+    uint32_t ratePeriod = pdMS_TO_TICKS(1000);
+
+    ulTaskNotifyTake(pdTRUE, timeout < ratePeriod ? timeout : ratePeriod);
+    updateIrqRate();
+
+#if BARCODE_CAPTURE_MODE == BARCODE_CAPTURE_DMA
+    processCapturedBlocks();
+#endif
+    drainEdges();
+
+#if BARCODE_TRACE_ENABLED
+    if (traceCount >= BARCODE_TRACE_RECORDS && traceTask != NULL) {
+        xTaskNotifyGive(traceTask);
     }
+#endif
 }
 
 /*** End of file ***/
\ No newline at end of file
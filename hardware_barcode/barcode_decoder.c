@@ -0,0 +1,258 @@
+/**
+ * @file barcode_decoder.c
+ *
+ * @brief Implements the hardware-independent barcode decoding pipeline.
+ *
+ * Edges become bar elements in a ring; every new element moves a 9-element window
+ * over the ring, which is decoded with the Code 39 table and nearest-match
+ * decoders. Characters are collected into a payload between '*' start and stop
+ * characters, read forwards or backwards.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hardware/barcode_decoder.h"
+#include "hardware/code39.h"
+#include "hardware/threshold.h"
+
+// Function to abandon the code being read and search for a start character again
+static void resetPayload(barcode_decoder_t *decoder) {
+    decoder->payloadDirection = BARCODE_SEARCHING;
+    decoder->payloadLength = 0;
+    decoder->nextCharacterEnd = 0;
+}
+
+// Function to decode the 9 newest elements. Each push moves the window by one
+// element, so every alignment of the stream is tried exactly once.
+//
+// While searching, every window is tried for a '*' start character in both
+// directions (a reversed '*' reads as 'P', so they cannot be confused). Such a
+// window may straddle two characters and match by accident, so it is only
+// accepted when the exact lookup and the nearest match agree.
+//
+// Inside a code, the next character is known to end 10 elements after the last
+// one (one gap space plus 9 elements). Only that aligned window is decoded, in
+// the code's direction and by nearest match, which tolerates a misread element.
+// Returns the decoded character, or 0.
+static char decodeLatestWindow(barcode_decoder_t *decoder) {
+    if (decoder->elementHead - decoder->elementConsumed < BARCODE_ARR_SIZE) {
+        return 0;
+    }
+
+    uint32_t first = decoder->elementHead - BARCODE_ARR_SIZE;
+
+    // Characters always start and end with a black bar
+    if (decoder->elementColours[first & BARCODE_RING_MASK] == 0) {
+        return 0;
+    }
+
+    code39_match_t match;
+
+    if (decoder->payloadDirection == BARCODE_SEARCHING) {
+        for (int reverse = 0; reverse < 2; reverse++) {
+            if (code39_decode_window(decoder->elementWidths, first, BARCODE_RING_MASK, reverse) != '*') {
+                continue;
+            }
+
+            code39_match_window(decoder->elementWidths, first, BARCODE_RING_MASK, reverse, &match);
+
+            if (match.character == '*') {
+                decoder->payloadDirection = reverse ? BARCODE_REVERSE : BARCODE_FORWARD;
+                decoder->payloadLength = 0;
+                decoder->payloadConfidence = match.confidence;
+                break;
+            }
+        }
+
+        if (decoder->payloadDirection == BARCODE_SEARCHING) {
+            return 0;
+        }
+    }
+    else {
+        if (decoder->elementHead != decoder->nextCharacterEnd) {
+            return 0;
+        }
+
+        code39_match_window(decoder->elementWidths, first, BARCODE_RING_MASK,
+                            decoder->payloadDirection == BARCODE_REVERSE, &match);
+
+        if (match.character == 0) {
+            // Lost sync with the character stream; search every alignment again
+            resetPayload(decoder);
+            return 0;
+        }
+
+        if (match.confidence < decoder->payloadConfidence) {
+            decoder->payloadConfidence = match.confidence;
+        }
+    }
+
+    decoder->elementConsumed = decoder->elementHead;
+    decoder->nextCharacterEnd = decoder->elementHead + 1 + BARCODE_ARR_SIZE;
+    decoder->lastConfidence = match.confidence;
+
+    return match.character;
+}
+
+// Function to check and strip the mod 43 check character of a payload in reading
+// order. Returns 1 if the payload is valid.
+static int verifyChecksum(char *data, uint32_t *length) {
+#if BARCODE_CHECKSUM_ENABLED
+    if (*length < 2) {
+        return 0;
+    }
+
+    uint32_t sum = 0;
+
+    for (uint32_t k = 0; k < *length - 1; k++) {
+        sum += code39_checksum_value(data[k]);
+    }
+
+    if (code39_checksum_character(sum % CODE39_CHECKSUM_MODULUS) != data[*length - 1]) {
+        return 0;
+    }
+
+    (*length)--;
+    data[*length] = '\0';
+#else
+    (void)data;
+    (void)length;
+#endif
+    return 1;
+}
+
+// Function to finish the code being read once its stop character is seen.
+// Returns 1 if a valid payload was stored.
+static int finishPayload(barcode_decoder_t *decoder) {
+    uint32_t length = decoder->payloadLength;
+    char data[BARCODE_MAX_PAYLOAD + 1];
+
+    // A reverse scan sees the last character first
+    for (uint32_t k = 0; k < length; k++) {
+        data[k] = decoder->payloadDirection == BARCODE_REVERSE ? decoder->payload[length - 1 - k] : decoder->payload[k];
+    }
+    data[length] = '\0';
+
+    if (!verifyChecksum(data, &length)) {
+        decoder->checksumFailures++;
+        return 0;
+    }
+
+    memcpy(decoder->lastPayload, data, length + 1);
+    decoder->lastPayloadConfidence = decoder->payloadConfidence;
+
+    return 1;
+}
+
+// Function to add a decoded character to the code being read. Returns 1 if it
+// completed a payload.
+static int addPayloadCharacter(barcode_decoder_t *decoder, char character) {
+    if (character != '*') {
+        if (decoder->payloadLength >= BARCODE_MAX_PAYLOAD) {
+            // Longer than any code we print; never had a stop character
+            resetPayload(decoder);
+            return 0;
+        }
+
+        decoder->payload[decoder->payloadLength++] = character;
+        return 0;
+    }
+
+    if (decoder->payloadLength == 0) {
+        // Start character, or "**" where a new code starts right after a gap
+        return 0;
+    }
+
+    int complete = finishPayload(decoder);
+    resetPayload(decoder);
+
+    return complete;
+}
+
+// Function to push a finished element into the ring, O(1)
+static int pushBarElement(barcode_decoder_t *decoder, int colour, uint32_t width) {
+    uint32_t slot = decoder->elementHead & BARCODE_RING_MASK;
+    decoder->elementWidths[slot] = width;
+    decoder->elementColours[slot] = colour;
+    decoder->elementHead++;
+
+    char read = decodeLatestWindow(decoder);
+
+    if (read == 0) {
+        return 0;
+    }
+
+    decoder->lastCharacter = read;
+
+    if (addPayloadCharacter(decoder, read)) {
+        return BARCODE_DECODED_CHARACTER | BARCODE_DECODED_PAYLOAD;
+    }
+
+    return BARCODE_DECODED_CHARACTER;
+}
+
+/**
+ * @brief Initializes a decoder with no elements and no payload.
+ *
+ * @param decoder Decoder to initialize.
+ */
+void barcode_decoder_init(barcode_decoder_t *decoder) {
+    memset(decoder, 0, sizeof(*decoder));
+    barcode_decoder_flush(decoder);
+}
+
+/**
+ * @brief Drops every element that has not been decoded yet and the code being read.
+ *
+ * Used when edges were lost, since the widths around the gap are meaningless.
+ *
+ * @param decoder Decoder to flush.
+ */
+void barcode_decoder_flush(barcode_decoder_t *decoder) {
+    decoder->elementConsumed = decoder->elementHead;
+    decoder->currentColour = -1;
+    resetPayload(decoder);
+}
+
+/**
+ * @brief Feeds one colour edge to a decoder.
+ *
+ * The element that was under the sensor ends at this edge and is decoded.
+ *
+ * @param decoder Decoder to feed.
+ * @param colour New colour under the sensor (0 - white, 1 - black).
+ * @param stamp Position of the edge in the width domain (microseconds or 1/256
+ *              notch); only differences are used, so it may wrap.
+ * @return BARCODE_DECODED_CHARACTER and/or BARCODE_DECODED_PAYLOAD, or 0.
+ */
+int barcode_decoder_edge(barcode_decoder_t *decoder, int colour, uint32_t stamp) {
+    int decoded = 0;
+
+    if (decoder->currentColour != -1) {
+        decoded = pushBarElement(decoder, decoder->currentColour, stamp - decoder->currentStart);
+    }
+
+    decoder->currentColour = colour;
+    decoder->currentStart = stamp;
+
+    return decoded;
+}
+
+/**
+ * @brief Classifies one averaged barcode ADC reading.
+ *
+ * @param threshold Adaptive threshold of the barcode channel.
+ * @param reading Averaged ADC reading (higher = darker).
+ * @param digital State of the sensor's digital output (1 = black).
+ * @return 1 for black, 0 for white.
+ */
+int barcode_classify(threshold_t *threshold, uint16_t reading, int digital) {
+    // The estimator's hysteresis keeps noise near the threshold from making edges
+    int colour = threshold_update(threshold, reading);
+
+    return colour || digital;
+}
+
+/*** End of file ***/
@@ -0,0 +1,271 @@
+/**
+ * @file code39.c
+ *
+ * @brief Implements the table-driven Code 39 character decoder.
+ *
+ * The 9 element widths of a character are reduced to a 9-bit wide/narrow pattern
+ * and looked up in a table indexed by that pattern. The table is filled in by the
+ * compiler from CODE39_PATTERNS using designated initializers, so it lives in flash
+ * and costs nothing at run time. Patterns that are not Code 39 characters map to 0.
+ *
+ * The nearest-match decoder scores every pattern in CODE39_PATTERNS against the
+ * measured widths, so one misread element costs confidence rather than the whole
+ * character.
+ *
+ */
+
+#include <stdint.h>
+
+#include "hardware/code39.h"
+
+// Builds one table entry from a CODE39_PATTERNS row.
+#define CODE39_TABLE_ENTRY(character, e0, e1, e2, e3, e4, e5, e6, e7, e8) \
+    [CODE39_PATTERN(e0, e1, e2, e3, e4, e5, e6, e7, e8)] = (character),
+
+// Lookup table from packed wide/narrow pattern to character (0 = no character).
+static const char code39Table[CODE39_TABLE_SIZE] = {
+    CODE39_PATTERNS(CODE39_TABLE_ENTRY)
+};
+
+// Builds one candidate list entry from a CODE39_PATTERNS row.
+#define CODE39_LIST_ENTRY(character, e0, e1, e2, e3, e4, e5, e6, e7, e8) \
+    { (character), CODE39_PATTERN(e0, e1, e2, e3, e4, e5, e6, e7, e8) },
+
+// Candidate characters for the nearest-match decoder.
+static const struct {
+    char character;
+    uint16_t pattern;
+} code39Patterns[] = {
+    CODE39_PATTERNS(CODE39_LIST_ENTRY)
+};
+
+#define CODE39_PATTERN_COUNT (sizeof(code39Patterns) / sizeof(code39Patterns[0]))
+
+// Ring index of element i of a window, read forwards or backwards.
+#define CODE39_WINDOW_INDEX(first, i, reverse) \
+    ((reverse) ? (first) + CODE39_ELEMENTS - 1 - (i) : (first) + (i))
+
+// Characters in mod 43 check value order.
+static const char code39ChecksumCharacters[CODE39_CHECKSUM_MODULUS + 1] =
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-. $/+%";
+
+// Width class of element i: bar or space, narrow or wide.
+#define CODE39_CLASS(i, wide) ((((i) & 1) << 1) | (wide))
+
+/**
+ * @brief Packs a window of 9 element widths out of a ring into a wide/narrow bit pattern.
+ *
+ * An element is wide when it is at least as long as the (truncated) mean element
+ * width, the same split the old thick/thin classification used.
+ *
+ * @param ring Element widths in any consistent unit.
+ * @param first Index of the first element of the window (masked with mask).
+ * @param mask Ring size minus one; the ring size must be a power of two.
+ * @param reverse Non-zero to read the window backwards (code scanned in reverse).
+ * @return The 9-bit pattern, first element in the most significant bit.
+ */
+uint16_t code39_pack_window(const uint32_t *ring, uint32_t first, uint32_t mask, int reverse) {
+    uint32_t total = 0;
+
+    for (int i = 0; i < CODE39_ELEMENTS; i++) {
+        total += ring[(first + i) & mask];
+    }
+
+    uint32_t mean = total / CODE39_ELEMENTS;
+    uint16_t pattern = 0;
+
+    for (int i = 0; i < CODE39_ELEMENTS; i++) {
+        pattern = (pattern << 1) | (ring[CODE39_WINDOW_INDEX(first, i, reverse) & mask] >= mean);
+    }
+
+    return pattern;
+}
+
+/**
+ * @brief Packs 9 element widths into a wide/narrow bit pattern.
+ *
+ * @param widths Widths of the 9 elements in any consistent unit.
+ * @return The 9-bit pattern, first element in the most significant bit.
+ */
+uint16_t code39_pack(const uint32_t widths[CODE39_ELEMENTS]) {
+    return code39_pack_window(widths, 0, UINT32_MAX, 0);
+}
+
+/**
+ * @brief Resolves a packed pattern to its Code 39 character.
+ *
+ * @param pattern 9-bit wide/narrow pattern.
+ * @return The character, or 0 if the pattern is not a Code 39 character.
+ */
+char code39_lookup(uint16_t pattern) {
+    return code39Table[pattern & (CODE39_TABLE_SIZE - 1)];
+}
+
+/**
+ * @brief Decodes 9 element widths into a Code 39 character.
+ *
+ * @param widths Widths of the 9 elements, starting with a bar.
+ * @return The character, or 0 if the widths do not form a Code 39 character.
+ */
+char code39_decode(const uint32_t widths[CODE39_ELEMENTS]) {
+    return code39_lookup(code39_pack(widths));
+}
+
+/**
+ * @brief Decodes a window of 9 element widths out of a ring into a Code 39 character.
+ *
+ * @param ring Element widths, the window starting with a bar.
+ * @param first Index of the first element of the window (masked with mask).
+ * @param mask Ring size minus one; the ring size must be a power of two.
+ * @param reverse Non-zero to read the window backwards (code scanned in reverse).
+ * @return The character, or 0 if the window is not a Code 39 character.
+ */
+char code39_decode_window(const uint32_t *ring, uint32_t first, uint32_t mask, int reverse) {
+    return code39_lookup(code39_pack_window(ring, first, mask, reverse));
+}
+
+/**
+ * @brief Scores how well measured widths fit one wide/narrow pattern.
+ *
+ * Under the pattern's assignment the narrow and wide widths of bars and spaces
+ * are averaged separately (print spread and sensor lag make bars and spaces
+ * differ). Each element then adds its distance from its class centre relative to
+ * that centre, and classes whose wide centre is less than 1.5 times the narrow
+ * one are penalised. A colour without any wide element borrows the wide/narrow
+ * ratio of the other colour, or 2.5 if neither has one.
+ *
+ * @param widths Widths of the 9 elements, starting with a bar.
+ * @param pattern Candidate 9-bit pattern.
+ * @return Weighted distance, 256 per narrow width of error.
+ */
+static uint32_t patternDistance(const uint32_t widths[CODE39_ELEMENTS], uint16_t pattern) {
+    uint32_t sum[4] = {0};
+    uint32_t count[4] = {0};
+
+    for (int i = 0; i < CODE39_ELEMENTS; i++) {
+        int k = CODE39_CLASS(i, (pattern >> (CODE39_ELEMENTS - 1 - i)) & 1);
+        sum[k] += widths[i];
+        count[k]++;
+    }
+
+    uint32_t centre[4];
+
+    for (int k = 0; k < 4; k++) {
+        centre[k] = count[k] ? sum[k] / count[k] : 0;
+    }
+
+    for (int colour = 0; colour < 2; colour++) {
+        int narrow = CODE39_CLASS(colour, 0);
+        int wide = CODE39_CLASS(colour, 1);
+        int otherNarrow = CODE39_CLASS(colour ^ 1, 0);
+        int otherWide = CODE39_CLASS(colour ^ 1, 1);
+
+        if (count[wide] == 0) {
+            uint32_t ratio = 640; // 2.5 in 1/256
+
+            if (count[otherWide] != 0 && centre[otherNarrow] != 0) {
+                ratio = centre[otherWide] * 256 / centre[otherNarrow];
+            }
+
+            centre[wide] = centre[narrow] * ratio / 256;
+        }
+    }
+
+    uint32_t distance = 0;
+
+    for (int i = 0; i < CODE39_ELEMENTS; i++) {
+        uint32_t c = centre[CODE39_CLASS(i, (pattern >> (CODE39_ELEMENTS - 1 - i)) & 1)];
+        uint32_t error = widths[i] > c ? widths[i] - c : c - widths[i];
+
+        distance += error * 256 / (c ? c : 1);
+    }
+
+    for (int colour = 0; colour < 2; colour++) {
+        uint32_t narrow = centre[CODE39_CLASS(colour, 0)];
+        uint32_t wide = centre[CODE39_CLASS(colour, 1)];
+
+        if (wide * 2 < narrow * 3) {
+            distance += (narrow * 3 - wide * 2) * 256 / (narrow ? narrow : 1);
+        }
+    }
+
+    return distance;
+}
+
+/**
+ * @brief Finds the Code 39 character nearest to a window of 9 element widths.
+ *
+ * Every candidate pattern is scored with patternDistance(). Confidence compares
+ * the best distance d1 with the runner-up d2 as 100 * (d2 - d1) / (d2 + d1), so it
+ * is 100 for an exact fit and falls to 0 as the two become indistinguishable.
+ * Matches below CODE39_MIN_CONFIDENCE are reported with character 0.
+ *
+ * @param ring Element widths, the window starting with a bar.
+ * @param first Index of the first element of the window (masked with mask).
+ * @param mask Ring size minus one; the ring size must be a power of two.
+ * @param reverse Non-zero to read the window backwards (code scanned in reverse).
+ * @param match Filled with the best character, its confidence and distance.
+ */
+void code39_match_window(const uint32_t *ring, uint32_t first, uint32_t mask, int reverse, code39_match_t *match) {
+    uint32_t widths[CODE39_ELEMENTS];
+
+    for (int i = 0; i < CODE39_ELEMENTS; i++) {
+        widths[i] = ring[CODE39_WINDOW_INDEX(first, i, reverse) & mask];
+    }
+
+    uint32_t best = UINT32_MAX;
+    uint32_t second = UINT32_MAX;
+    char character = 0;
+
+    for (uint32_t p = 0; p < CODE39_PATTERN_COUNT; p++) {
+        uint32_t distance = patternDistance(widths, code39Patterns[p].pattern);
+
+        if (distance < best) {
+            second = best;
+            best = distance;
+            character = code39Patterns[p].character;
+        }
+        else if (distance < second) {
+            second = distance;
+        }
+    }
+
+    uint64_t spread = (uint64_t)second + best;
+    uint8_t confidence = spread ? (uint8_t)(100 * (uint64_t)(second - best) / spread) : 0;
+
+    match->character = confidence >= CODE39_MIN_CONFIDENCE ? character : 0;
+    match->confidence = confidence;
+    match->distance = best;
+}
+
+/**
+ * @brief Gets the mod 43 check value of a character.
+ *
+ * @param character A Code 39 data character.
+ * @return The value 0-42, or -1 for '*' and non-Code 39 characters.
+ */
+int code39_checksum_value(char character) {
+    for (int value = 0; value < CODE39_CHECKSUM_MODULUS; value++) {
+        if (code39ChecksumCharacters[value] == character) {
+            return value;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Gets the character for a mod 43 check value.
+ *
+ * @param value The check value, 0-42.
+ * @return The character, or 0 if value is out of range.
+ */
+char code39_checksum_character(int value) {
+    if (value < 0 || value >= CODE39_CHECKSUM_MODULUS) {
+        return 0;
+    }
+
+    return code39ChecksumCharacters[value];
+}
+
+/*** End of file ***/
@@ -8,12 +8,21 @@
  * the barcode signals, and utility functions for barcode data handling. The file supports
  * barcode processing and interpretation based on the Code 39 barcode standard.
  *
+ * Decoded payloads are delivered as events. Each consumer calls barcode_subscribe()
+ * once and then blocks on or polls its own bounded queue with barcode_get_event(),
+ * so several consumers see every payload without polling the decoder.
+ *
  */
 
 #ifndef _BARCODE_H
 #define _BARCODE_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/barcode_decoder.h"
+#include "hardware/barcode_trace.h"
+#include "hardware/threshold.h"
 
 // Constants for barcode processing
 #define TABLE_SIZE 100
@@ -22,24 +31,72 @@
 #define UART_RX_PIN 1
 #define ADC_PIN 26
 #define DIGITAL_PIN 22
-#define BLACK_THRESHOLD 1000
-#define WHITE_THRESHOLD 400
-#define BARCODE_BUF_SIZE 10
-#define BARCODE_ARR_SIZE 9
-#define ADC_DIFFERENCE_THRESHHOLD 50
+#define BARCODE_EDGE_QUEUE_SIZE 32  // Edges buffered between capture and decode, a power of two
+#define BARCODE_EDGE_QUEUE_MASK (BARCODE_EDGE_QUEUE_SIZE - 1)
 #define SAMPLE_SIZE 10000
 
-struct voltageClassification;
+// Capture modes: one ADC IRQ per sample, or DMA filling double-buffered blocks
+#define BARCODE_CAPTURE_IRQ 0
+#define BARCODE_CAPTURE_DMA 1
+#ifndef BARCODE_CAPTURE_MODE
+#define BARCODE_CAPTURE_MODE BARCODE_CAPTURE_DMA
+#endif
+
+// Width domains: wall-clock time between edges, or distance the wheels travelled
+// between them. Distance widths do not change when the car speeds up or slows
+// down over a code, so codes can be read at full line-following speed.
+#define BARCODE_WIDTH_TIME 0
+#define BARCODE_WIDTH_DISTANCE 1
+#ifndef BARCODE_WIDTH_DOMAIN
+#define BARCODE_WIDTH_DOMAIN BARCODE_WIDTH_TIME
+#endif
+
+#define BARCODE_DECIMATION 100          // Raw ADC samples averaged into one reading
+#define BARCODE_ADC_SAMPLE_US 2         // Free-running ADC (clkdiv 0) takes a sample every 2 us
+#define BARCODE_DMA_BLOCK_SAMPLES 1000  // Samples per DMA block, a multiple of BARCODE_DECIMATION
+
+// Set to 1 to record the readings the edge detector sees and print each full trace
+// over stdio for tools/barcode_replay (see barcode_trace.h). The readings are the
+// BARCODE_DECIMATION averages, not raw ADC samples: raw samples come every 2 us,
+// so the same 0.8 s would need 800 KB, and the decoder only ever sees averages.
+// Traces are printed by barcode_trace_task.
+#ifndef BARCODE_TRACE_ENABLED
+#define BARCODE_TRACE_ENABLED 0
+#endif
+#define BARCODE_TRACE_RECORDS 4096      // Readings per trace, about 0.8 s at one per 200 us
+#define BARCODE_TRACE_TASK_PRIORITY 1   // Below the decode task, so printing does not stall decoding
+#define BARCODE_TRACE_RECORD_SIZE (BARCODE_WIDTH_DOMAIN == BARCODE_WIDTH_DISTANCE ? \
+    BARCODE_TRACE_DISTANCE_RECORD_SIZE : BARCODE_TRACE_TIME_RECORD_SIZE)
+
+#define BARCODE_MAX_SUBSCRIBERS 4       // Consumers of barcode events
+#define BARCODE_EVENT_QUEUE_DEPTH 8     // Events buffered per consumer
+
+// One decoded payload
+typedef struct {
+    char payload[BARCODE_MAX_PAYLOAD + 1];  // In reading order, without start/stop characters
+    uint8_t confidence;                     // Lowest character confidence, 0-100
+    uint64_t time_us;                       // When the stop character was read, microseconds since boot
+    uint32_t position;                      // Mean wheel position then, in 1/256 notch
+} barcode_event_t;
 
 void barcode_setup();
-void barcode_main_loop();
-static int* thickThinClassification();
-static int isVoltageClassificationFull();
-static void flushVoltageClassification();
-static char compareTwoArray ();
-static void appendVoltageClassification(struct voltageClassification voltageClassification);
+void barcode_process_samples(uint32_t timeout);
+int barcode_subscribe();
+int barcode_get_event(int subscriber, barcode_event_t *event, uint32_t timeout);
+uint32_t barcode_get_dropped_events(int subscriber);
+uint32_t barcode_get_irq_rate();
+uint32_t barcode_get_isr_max_us();
+uint32_t barcode_get_dropped_blocks();
+uint32_t barcode_get_checksum_failures();
+void barcode_get_threshold_levels(threshold_levels_t *levels);
+#if BARCODE_TRACE_ENABLED
+void barcode_trace_task(void *params);
+#endif
+#if BARCODE_CAPTURE_MODE == BARCODE_CAPTURE_DMA
+static void DMA_IRQ_CAPTURE_HANDLER();
+#else
 static void ADC_IRQ_FIFO_HANDLER();
-char getBarcodeChar();
+#endif
 
 #endif
 
@@ -0,0 +1,88 @@
+/**
+ * @file barcode_decoder.h
+ *
+ * @brief Provides the hardware-independent part of the barcode reader.
+ *
+ * The decoder turns colour edges into bar elements and bar elements into Code 39
+ * payloads: it keeps the element ring, finds the '*' start character in either
+ * direction, decodes the aligned characters that follow and checks the optional
+ * mod 43 check character. barcode_classify() turns one averaged ADC reading into
+ * a colour with the adaptive threshold.
+ *
+ * The firmware (barcode.c) and the host replay tool (tools/barcode_replay.c) both
+ * drive this code, so a recorded trace is decoded exactly as it was on the car.
+ * It only depends on the C standard headers, code39 and threshold.
+ *
+ */
+
+#ifndef _BARCODE_DECODER_H
+#define _BARCODE_DECODER_H
+
+#include <stdint.h>
+
+#include "hardware/threshold.h"
+
+// Constants for barcode decoding
+#define BARCODE_RING_SIZE 16   // Bar elements kept for decoding, a power of two above BARCODE_ARR_SIZE
+#define BARCODE_RING_MASK (BARCODE_RING_SIZE - 1)
+#define BARCODE_ARR_SIZE 9
+#define BARCODE_MAX_PAYLOAD 32          // Longest payload between start and stop characters
+
+// Starting levels of the adaptive threshold, centred on the old fixed cut-off of 1000
+#define BARCODE_WHITE_LEVEL 400
+#define BARCODE_BLACK_LEVEL 1600
+#define BARCODE_THRESHOLD_DECAY_SHIFT 12  // Levels forget over 4096 readings, about 0.8 s
+
+// Direction of the code being read
+#define BARCODE_SEARCHING -1            // No start character seen yet
+#define BARCODE_FORWARD 0
+#define BARCODE_REVERSE 1
+
+// Set to 1 when codes carry a mod 43 check character before the stop character;
+// it is verified and stripped from the payload.
+#ifndef BARCODE_CHECKSUM_ENABLED
+#define BARCODE_CHECKSUM_ENABLED 0
+#endif
+
+// Flags returned by barcode_decoder_edge()
+#define BARCODE_DECODED_CHARACTER 1     // lastCharacter holds a new character
+#define BARCODE_DECODED_PAYLOAD 2       // lastPayload holds a new complete payload
+
+// Decoder state
+typedef struct {
+    // Ring of finished bar elements, indexed by push count masked to the ring size.
+    // Widths are kept in their own array so the Code 39 decoder can read any
+    // 9-element window straight out of the ring without copying it.
+    uint32_t elementWidths[BARCODE_RING_SIZE];
+    uint8_t elementColours[BARCODE_RING_SIZE];  // 0 - white, 1 - black
+    uint32_t elementHead;                       // Number of elements pushed so far
+    uint32_t elementConsumed;                   // Elements before this belong to a decoded character
+    uint32_t nextCharacterEnd;                  // Push count the next character should end at (0 = unknown)
+
+    // Element currently under the sensor, not finished until the next edge
+    int currentColour;
+    uint32_t currentStart;
+
+    // Code currently being read: direction and the data characters so far
+    int payloadDirection;
+    char payload[BARCODE_MAX_PAYLOAD + 1];
+    uint32_t payloadLength;
+    uint8_t payloadConfidence;                  // Lowest character confidence in the code
+
+    // Last decoded character and last complete payload, in reading order
+    char lastCharacter;
+    uint8_t lastConfidence;
+    char lastPayload[BARCODE_MAX_PAYLOAD + 1];
+    uint8_t lastPayloadConfidence;
+
+    uint32_t checksumFailures;                  // Codes that failed their check character
+} barcode_decoder_t;
+
+void barcode_decoder_init(barcode_decoder_t *decoder);
+void barcode_decoder_flush(barcode_decoder_t *decoder);
+int barcode_decoder_edge(barcode_decoder_t *decoder, int colour, uint32_t stamp);
+int barcode_classify(threshold_t *threshold, uint16_t reading, int digital);
+
+#endif
+
+/*** End of file ***/
@@ -0,0 +1,51 @@
+/**
+ * @file barcode_trace.h
+ *
+ * @brief Defines the barcode trace format shared by the recorder and replay tool.
+ *
+ * A trace is the stream of averaged ADC readings the edge detector saw, so a
+ * decode failure on the car can be replayed offline through the same decoder.
+ * Raw ADC samples are not kept: the decoder never sees them, and at one every
+ * 2 us they would not fit in RAM for a useful length of trace.
+ * All fields are little-endian.
+ *
+ * Header (BARCODE_TRACE_HEADER_SIZE bytes):
+ *     0   char[4]   magic "BCTR"
+ *     4   uint8     format version (BARCODE_TRACE_VERSION)
+ *     5   uint8     width domain (BARCODE_WIDTH_TIME or BARCODE_WIDTH_DISTANCE)
+ *     6   uint16    record size in bytes
+ *     8   uint32    number of records
+ *     12  uint32    time of the first reading, microseconds since boot
+ *
+ * Record (4 bytes, 6 in the distance domain):
+ *     0   uint16    reading in bits 0-11, digital pin state in bit 15
+ *     2   uint16    microseconds since the previous reading (saturates at 65535)
+ *     4   uint16    1/256 notches travelled since the previous reading (distance only)
+ *
+ * On the car a low-priority task prints each full trace over stdio as hex, 32
+ * bytes per line, between BARCODE_TRACE_BEGIN and BARCODE_TRACE_END lines.
+ * tools/barcode_replay reads either that log or the raw binary.
+ *
+ */
+
+#ifndef _BARCODE_TRACE_H
+#define _BARCODE_TRACE_H
+
+#include <stdint.h>
+
+// Constants for the trace format
+#define BARCODE_TRACE_MAGIC "BCTR"
+#define BARCODE_TRACE_VERSION 1
+#define BARCODE_TRACE_HEADER_SIZE 16
+#define BARCODE_TRACE_TIME_RECORD_SIZE 4
+#define BARCODE_TRACE_DISTANCE_RECORD_SIZE 6
+#define BARCODE_TRACE_READING_MASK 0x0FFF
+#define BARCODE_TRACE_DIGITAL_BIT 0x8000
+#define BARCODE_TRACE_DELTA_MAX 0xFFFF
+#define BARCODE_TRACE_BEGIN "BCTR-BEGIN"
+#define BARCODE_TRACE_END "BCTR-END"
+#define BARCODE_TRACE_LINE_BYTES 32
+
+#endif
+
+/*** End of file ***/
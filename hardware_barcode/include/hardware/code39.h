@@ -0,0 +1,108 @@
+/**
+ * @file code39.h
+ *
+ * @brief Provides an allocation-free Code 39 character decoder.
+ *
+ * A Code 39 character is made of 9 elements (5 bars and 4 spaces, starting with
+ * a bar), 3 of which are wide. The full 43-character set plus the '*' start/stop
+ * character is supported. The decoder packs the 9 measured element widths
+ * into a 9-bit pattern (1 = wide, first element in the most significant bit) and
+ * resolves the character with a single lookup in a 512-entry table that the
+ * compiler builds from CODE39_PATTERNS. Decoding never touches the heap and always
+ * runs the same fixed number of steps, so it is safe to call from interrupt context.
+ *
+ * For damaged reads, code39_match_window() instead fits narrow and wide widths for
+ * bars and spaces separately under each candidate pattern and picks the pattern
+ * with the smallest weighted distance, together with a 0-100 confidence.
+ *
+ * A code scanned backwards yields each character's elements in reverse order, so
+ * the window decoders take a reverse flag. code39_checksum_value() gives the mod 43
+ * value of a data character for the optional check character.
+ *
+ * The module only depends on the C standard headers so it can also be built on
+ * a host machine (see tools/code39_bench.c).
+ *
+ */
+
+#ifndef _CODE39_H
+#define _CODE39_H
+
+#include <stdint.h>
+
+// Constants for Code 39 decoding
+#define CODE39_ELEMENTS 9
+#define CODE39_TABLE_SIZE (1 << CODE39_ELEMENTS)
+#define CODE39_MIN_CONFIDENCE 10        // Matches below this confidence are rejected
+#define CODE39_CHECKSUM_MODULUS 43
+
+// Packs 9 wide (1) / narrow (0) flags into a pattern, first element in bit 8.
+#define CODE39_PATTERN(e0, e1, e2, e3, e4, e5, e6, e7, e8) \
+    (((e0) << 8) | ((e1) << 7) | ((e2) << 6) | ((e3) << 5) | ((e4) << 4) | \
+     ((e5) << 3) | ((e6) << 2) | ((e7) << 1) | (e8))
+
+// Code 39 characters and their wide/narrow element patterns (bar, space, bar, ...).
+#define CODE39_PATTERNS(X) \
+    X('0', 0,0,0,1,1,0,1,0,0) \
+    X('1', 1,0,0,1,0,0,0,0,1) \
+    X('2', 0,0,1,1,0,0,0,0,1) \
+    X('3', 1,0,1,1,0,0,0,0,0) \
+    X('4', 0,0,0,1,1,0,0,0,1) \
+    X('5', 1,0,0,1,1,0,0,0,0) \
+    X('6', 0,0,1,1,1,0,0,0,0) \
+    X('7', 0,0,0,1,0,0,1,0,1) \
+    X('8', 1,0,0,1,0,0,1,0,0) \
+    X('9', 0,0,1,1,0,0,1,0,0) \
+    X('A', 1,0,0,0,0,1,0,0,1) \
+    X('B', 0,0,1,0,0,1,0,0,1) \
+    X('C', 1,0,1,0,0,1,0,0,0) \
+    X('D', 0,0,0,0,1,1,0,0,1) \
+    X('E', 1,0,0,0,1,1,0,0,0) \
+    X('F', 0,0,1,0,1,1,0,0,0) \
+    X('G', 0,0,0,0,0,1,1,0,1) \
+    X('H', 1,0,0,0,0,1,1,0,0) \
+    X('I', 0,0,1,0,0,1,1,0,0) \
+    X('J', 0,0,0,0,1,1,1,0,0) \
+    X('K', 1,0,0,0,0,0,0,1,1) \
+    X('L', 0,0,1,0,0,0,0,1,1) \
+    X('M', 1,0,1,0,0,0,0,1,0) \
+    X('N', 0,0,0,0,1,0,0,1,1) \
+    X('O', 1,0,0,0,1,0,0,1,0) \
+    X('P', 0,0,1,0,1,0,0,1,0) \
+    X('Q', 0,0,0,0,0,0,1,1,1) \
+    X('R', 1,0,0,0,0,0,1,1,0) \
+    X('S', 0,0,1,0,0,0,1,1,0) \
+    X('T', 0,0,0,0,1,0,1,1,0) \
+    X('U', 1,1,0,0,0,0,0,0,1) \
+    X('V', 0,1,1,0,0,0,0,0,1) \
+    X('W', 1,1,1,0,0,0,0,0,0) \
+    X('X', 0,1,0,0,1,0,0,0,1) \
+    X('Y', 1,1,0,0,1,0,0,0,0) \
+    X('Z', 0,1,1,0,1,0,0,0,0) \
+    X('-', 0,1,0,0,0,0,1,0,1) \
+    X('.', 1,1,0,0,0,0,1,0,0) \
+    X(' ', 0,1,1,0,0,0,1,0,0) \
+    X('$', 0,1,0,1,0,1,0,0,0) \
+    X('/', 0,1,0,1,0,0,0,1,0) \
+    X('+', 0,1,0,0,0,1,0,1,0) \
+    X('%', 0,0,0,1,0,1,0,1,0) \
+    X('*', 0,1,0,0,1,0,1,0,0)
+
+// Result of a nearest-match decode
+typedef struct {
+    char character;         // Best matching character, 0 if rejected
+    uint8_t confidence;     // 0 (as good as the runner-up) to 100 (exact fit)
+    uint32_t distance;      // Weighted distance of the best pattern, 256 = one narrow width
+} code39_match_t;
+
+uint16_t code39_pack(const uint32_t widths[CODE39_ELEMENTS]);
+uint16_t code39_pack_window(const uint32_t *ring, uint32_t first, uint32_t mask, int reverse);
+char code39_lookup(uint16_t pattern);
+char code39_decode(const uint32_t widths[CODE39_ELEMENTS]);
+char code39_decode_window(const uint32_t *ring, uint32_t first, uint32_t mask, int reverse);
+void code39_match_window(const uint32_t *ring, uint32_t first, uint32_t mask, int reverse, code39_match_t *match);
+int code39_checksum_value(char character);
+char code39_checksum_character(int value);
+
+#endif
+
+/*** End of file ***/
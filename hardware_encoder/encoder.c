@@ -2,6 +2,17 @@
  *
  * @brief This module handles the operations related to wheel encoders in a robotic car.
  *        It includes functions for calculating the speed and distance traveled by each wheel.
+ *        The encoder ISRs only store edge counts and timestamps (the RP2040 has no FPU);
+ *        distance and speed are computed in fixed point when they are read.
+ *
+ *        With ENCODER_BACKEND_PIO, a PIO state machine per wheel timestamps every edge
+ *        (encoder.pio) and DMA moves the timestamps into the same edge ring, so the
+ *        encoders take no CPU interrupts at all. The edge count is the number of
+ *        words the DMA channel has moved.
+ *
+ *        The edge count doubles as a sequence number: readers copy what they need and
+ *        retry if a count moved meanwhile, so no reader ever masks interrupts.
+ *        encoder_get_snapshot() does this for both wheels at once.
  */
 
 #include <stdio.h>
@@ -9,21 +20,204 @@
 #include "hardware/gpio.h"
 #include "hardware/encoder.h"
 
-// Global variables to store measurement data for the left wheel
-volatile uint32_t leftNotchCount = 0;
-volatile uint32_t tempLeftNotchCount = 0;
-volatile double leftTotalDistance = 0.0;
-volatile double tempLeftTotalDistance = 0.0;
-volatile uint64_t leftLastNotchTime = 0;
-volatile double leftEncoderSpeed = 0.0;
+#if ENCODER_BACKEND == ENCODER_BACKEND_PIO
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "encoder.pio.h"
+#endif
+
+// Edges seen by one wheel: a free-running edge count and the time of each of the
+// last ENCODER_EDGE_RING_SIZE edges, indexed by edge number masked to the ring size.
+// The ISR (or DMA) only writes these; distance and speed are derived when they are
+// asked for.
+struct wheelEdges {
+#if ENCODER_BACKEND == ENCODER_BACKEND_PIO
+    volatile uint32_t times[ENCODER_EDGE_RING_SIZE];   // PIO timestamps (X), written by DMA
+    int dmaChannel;                                     // Its transfer count gives the edge count
+#else
+    volatile uint32_t times[ENCODER_EDGE_RING_SIZE];   // 32-bit microseconds since boot
+    volatile uint32_t count;
+#endif
+};
+
+// The DMA write ring wraps on an address boundary of its own size
+static struct wheelEdges leftEdges __attribute__((aligned(ENCODER_EDGE_RING_SIZE * 4)));
+static struct wheelEdges rightEdges __attribute__((aligned(ENCODER_EDGE_RING_SIZE * 4)));
+
+#if ENCODER_BACKEND == ENCODER_BACKEND_PIO
+// Time the state machines were started; PIO timestamps count from here
+static uint32_t pioStartUs;
+
+/*!
+ * @brief Reads how many edges a wheel has seen.
+ *
+ * The DMA channel started with ENCODER_DMA_TRANSFERS to do and moves one word
+ * per edge. The word is written a few bus cycles after the count drops, well
+ * before the caller gets to read it.
+ *
+ * @param[in] wheel Edges of the wheel.
+ * @return Edge count.
+ */
+static inline uint32_t edgeCount(const struct wheelEdges *wheel) {
+    return ENCODER_DMA_TRANSFERS - dma_channel_hw_addr(wheel->dmaChannel)->transfer_count;
+}
+
+/*!
+ * @brief Reads the time of one edge from the ring.
+ *
+ * @param[in] wheel Edges of the wheel.
+ * @param[in] index Edge number.
+ * @return Edge time in 32-bit microseconds since boot.
+ */
+static inline uint32_t edgeTime(const struct wheelEdges *wheel, uint32_t index) {
+    return pioStartUs + ~wheel->times[index & ENCODER_EDGE_RING_MASK];
+}
+#else
+static inline uint32_t edgeCount(const struct wheelEdges *wheel) {
+    return wheel->count;
+}
+
+static inline uint32_t edgeTime(const struct wheelEdges *wheel, uint32_t index) {
+    return wheel->times[index & ENCODER_EDGE_RING_MASK];
+}
+#endif
+
+/*!
+ * @brief Copies the times of the newest edges of a wheel up to a given count.
+ *
+ * The copy is only consistent if the count is unchanged afterwards.
+ *
+ * @param[in] wheel Edges of the wheel.
+ * @param[in] count Edge count read before the copy.
+ * @param[out] times Times of the newest edges, newest first.
+ * @param[in] edges Number of times to copy, at most ENCODER_EDGE_RING_SIZE.
+ */
+static inline void copyTimes(const struct wheelEdges *wheel, uint32_t count, uint32_t *times, uint32_t edges) {
+    for (uint32_t k = 0; k < edges; k++) {
+        times[k] = edgeTime(wheel, count - 1 - k);
+    }
+}
+
+/*!
+ * @brief Copies the edge count and the times of the newest edges of a wheel.
+ *
+ * The ISR may add an edge while the times are read, so the copy is taken again
+ * until the count is unchanged around it.
+ *
+ * @param[in] wheel Edges of the wheel.
+ * @param[out] times Times of the newest edges, newest first.
+ * @param[in] edges Number of times to copy, at most ENCODER_EDGE_RING_SIZE.
+ * @return Edge count the times belong to.
+ */
+static uint32_t copyEdges(const struct wheelEdges *wheel, uint32_t *times, uint32_t edges) {
+    uint32_t count;
+
+    do {
+        count = edgeCount(wheel);
+        copyTimes(wheel, count, times, edges);
+    } while (count != edgeCount(wheel));
+
+    return count;
+}
+
+/*!
+ * @brief Converts notches travelled over a time into a speed.
+ *
+ * Saturates at ENCODER_MAX_SPEED_CM_S. Without the cap, intervals of a few
+ * microseconds (contact bounce) would overflow 32 bits and wrap to any speed.
+ *
+ * @param[in] notches Notches travelled.
+ * @param[in] us Time taken in microseconds, not zero.
+ * @return Speed in cm/s, Q16 fixed point.
+ */
+static uint32_t notchSpeed(uint32_t notches, uint32_t us) {
+    // um/us is m/s; times 100 gives cm/s
+    uint64_t speed = ((uint64_t)notches * ENCODER_UM_PER_NOTCH * 100 << ENCODER_SPEED_FRACTION_BITS) / us;
+    uint64_t limit = (uint64_t)ENCODER_MAX_SPEED_CM_S << ENCODER_SPEED_FRACTION_BITS;
+
+    return (uint32_t)(speed > limit ? limit : speed);
+}
+
+/*!
+ * @brief Estimates the speed of a wheel from its recent edge times.
+ *
+ * Two estimates are blended. The period estimate is one notch over the latest
+ * edge interval and reacts within one notch, but carries the full jitter of a
+ * single interval. The window estimate averages the intervals that ended within
+ * the last ENCODER_SPEED_WINDOW_US (up to NOTCHES_PER_CYCLE of them). The window
+ * estimate's weight grows with the number of intervals it holds, so it dominates
+ * at speed and the period estimate dominates when edges are sparse.
+ *
+ * If no edge has arrived for longer than the latest interval, the wheel has
+ * slowed down, and the speed is capped at one notch over the time since that
+ * edge. It therefore decays smoothly instead of holding its last value, and it
+ * reads zero after ENCODER_STOP_US without an edge.
+ *
+ * @param[in] times Times of the newest NOTCHES_PER_CYCLE + 1 edges, newest first.
+ * @param[in] count Edge count the times belong to.
+ * @param[in] now Time to estimate the speed at, in 32-bit microseconds since boot.
+ * @return Speed in cm/s, Q16 fixed point.
+ */
+static uint32_t speedFromTimes(const uint32_t *times, uint32_t count, uint32_t now) {
+    int32_t age = (int32_t)(now - times[0]);
 
-// Global variables to store measurement data for the right wheel
-volatile uint32_t rightNotchCount = 0;
-volatile uint32_t tempRightNotchCount = 0;
-volatile double rightTotalDistance = 0.0;
-volatile double tempRightTotalDistance = 0.0;
-volatile uint64_t rightLastNotchTime = 0;
-volatile double rightEncoderSpeed = 0.0;
+    if (count < 2 || age > ENCODER_STOP_US) {
+        return 0;
+    }
+
+    if (age < 0) {
+        // An edge arrived after the copy
+        age = 0;
+    }
+
+    uint32_t period = times[0] - times[1];
+    if (period == 0) {
+        return 0;
+    }
+
+    uint32_t speed = notchSpeed(1, period);
+
+    // Intervals that ended inside the window, oldest edge first out
+    uint32_t available = count - 1 < NOTCHES_PER_CYCLE ? count - 1 : NOTCHES_PER_CYCLE;
+    uint32_t intervals = 0;
+
+    while (intervals < available &&
+           (uint32_t)(times[0] - times[intervals + 1]) + (uint32_t)age <= ENCODER_SPEED_WINDOW_US) {
+        intervals++;
+    }
+
+    if (intervals > 1) {
+        uint32_t windowSpeed = notchSpeed(intervals, times[0] - times[intervals]);
+
+        speed = (uint32_t)(((uint64_t)windowSpeed * intervals +
+                            (uint64_t)speed * (NOTCHES_PER_CYCLE - intervals)) / NOTCHES_PER_CYCLE);
+    }
+
+    // No edge for longer than a notch at this speed: the wheel has slowed
+    if ((uint32_t)age > period) {
+        uint32_t bound = notchSpeed(1, age);
+
+        if (speed > bound) {
+            speed = bound;
+        }
+    }
+
+    return speed;
+}
+
+/*!
+ * @brief Estimates the speed of a wheel now.
+ *
+ * @param[in] wheel Edges of the wheel.
+ * @return Speed in cm/s, Q16 fixed point.
+ */
+static uint32_t speedOf(const struct wheelEdges *wheel) {
+    uint32_t times[NOTCHES_PER_CYCLE + 1];
+    uint32_t count = copyEdges(wheel, times, NOTCHES_PER_CYCLE + 1);
+
+    return speedFromTimes(times, count, time_us_32());
+}
 
 /*!
  * @brief Retrieves the current speed of the left wheel.
@@ -32,7 +226,17 @@ volatile double rightEncoderSpeed = 0.0;
  * @return The speed of the left wheel.
  */
 double getLeftSpeed(void *params) {
-    return leftEncoderSpeed;
+    return (double)speedOf(&leftEdges) / (1 << ENCODER_SPEED_FRACTION_BITS);
+}
+
+/*!
+ * @brief Retrieves the current speed of the left wheel in fixed point.
+ *
+ * @param[in] params Optional parameters (unused in this function).
+ * @return The speed of the left wheel in cm/s, Q16 fixed point.
+ */
+uint32_t getLeftSpeedFixed(void *params) {
+    return speedOf(&leftEdges);
 }
 
 /*!
@@ -42,7 +246,17 @@ double getLeftSpeed(void *params) {
  * @return The speed of the right wheel.
  */
 double getRightSpeed(void *params) {
-    return rightEncoderSpeed;
+    return (double)speedOf(&rightEdges) / (1 << ENCODER_SPEED_FRACTION_BITS);
+}
+
+/*!
+ * @brief Retrieves the current speed of the right wheel in fixed point.
+ *
+ * @param[in] params Optional parameters (unused in this function).
+ * @return The speed of the right wheel in cm/s, Q16 fixed point.
+ */
+uint32_t getRightSpeedFixed(void *params) {
+    return speedOf(&rightEdges);
 }
 
 /*!
@@ -52,7 +266,7 @@ double getRightSpeed(void *params) {
  * @return The total notch count for the left wheel.
  */
 uint32_t getLeftNotchCount(void *params) {
-    return leftNotchCount;
+    return edgeCount(&leftEdges);
 }
 
 /*!
@@ -62,78 +276,239 @@ uint32_t getLeftNotchCount(void *params) {
  * @return The total notch count for the right wheel.
  */
 uint32_t getRightNotchCount(void *params) {
-    return rightNotchCount;
+    return edgeCount(&rightEdges);
 }
 
 /*!
- * @brief Interrupt service routine for the left wheel encoder.
- *        Increments the notch count and calculates the speed of the left wheel.
+ * @brief Retrieves the total distance traveled by the left wheel.
  *
  * @param[in] params Optional parameters (unused in this function).
+ * @return The distance in millimetres.
  */
-void leftEncoder(void *params) {
-    // Increment the count of notches detected for the left wheel
-    leftNotchCount++;
-    tempLeftNotchCount++;
+uint32_t getLeftDistance(void *params) {
+    return (uint64_t)edgeCount(&leftEdges) * ENCODER_UM_PER_NOTCH / 1000;
+}
 
-    // Calculate the total distance traveled by the left wheel in centimeters
-    leftTotalDistance = (double)leftNotchCount * CM_PER_NOTCH;
-    tempLeftTotalDistance = (double)tempLeftNotchCount * CM_PER_NOTCH;
+/*!
+ * @brief Retrieves the total distance traveled by the right wheel.
+ *
+ * @param[in] params Optional parameters (unused in this function).
+ * @return The distance in millimetres.
+ */
+uint32_t getRightDistance(void *params) {
+    return (uint64_t)edgeCount(&rightEdges) * ENCODER_UM_PER_NOTCH / 1000;
+}
 
-    // Calculate speed traveled after every cycle
-    if (tempLeftNotchCount % NOTCHES_PER_CYCLE == 0) {
-        // Get the current time in microseconds
-        uint64_t currentTime = time_us_64();
+/*!
+ * @brief Fills in one wheel of a snapshot from its copied edges.
+ *
+ * @param[out] state Wheel state to fill in.
+ * @param[in] times Times of the newest NOTCHES_PER_CYCLE + 1 edges, newest first.
+ * @param[in] count Edge count the times belong to.
+ * @param[in] now Time of the snapshot.
+ */
+static void fillWheelState(encoder_wheel_state_t *state, const uint32_t *times, uint32_t count, uint32_t now) {
+    state->count = count;
+    state->distance = (uint64_t)count * ENCODER_UM_PER_NOTCH / 1000;
+    state->speed = speedFromTimes(times, count, now);
+    state->lastEdgeUs = count ? times[0] : 0;
+}
 
-        // Calculate the time difference between the current and previous notch
-        uint64_t timeDiff = currentTime - leftLastNotchTime;
+/*!
+ * @brief Takes a consistent snapshot of both wheels.
+ *
+ * Both edge counts act as sequence numbers: the counts and edge times of both
+ * wheels are copied and the copy is retried if either count moved meanwhile, so
+ * every field belongs to the same instant without masking interrupts. A retry
+ * needs an edge to land inside a copy of a few microseconds, so one pass is the
+ * norm even at full speed. Cheap enough for a 1 kHz control loop.
+ *
+ * @param[out] snapshot Counts, distances, speeds and last edge times of both wheels.
+ */
+void encoder_get_snapshot(encoder_snapshot_t *snapshot) {
+    uint32_t leftTimes[NOTCHES_PER_CYCLE + 1];
+    uint32_t rightTimes[NOTCHES_PER_CYCLE + 1];
+    uint32_t left;
+    uint32_t right;
+    uint32_t now;
 
-        if (timeDiff > 0) {
-            // Calculate speed (distance traveled in 1 second) for the left wheel
-            leftEncoderSpeed = tempLeftTotalDistance * 1e6 / timeDiff;
-        }
+    do {
+        left = edgeCount(&leftEdges);
+        right = edgeCount(&rightEdges);
+        copyTimes(&leftEdges, left, leftTimes, NOTCHES_PER_CYCLE + 1);
+        copyTimes(&rightEdges, right, rightTimes, NOTCHES_PER_CYCLE + 1);
+        now = time_us_32();
+    } while (left != edgeCount(&leftEdges) || right != edgeCount(&rightEdges));
 
-        // Update the last notch time for the left wheel
-        leftLastNotchTime = currentTime;
+    snapshot->time_us = now;
+    fillWheelState(&snapshot->left, leftTimes, left, now);
+    fillWheelState(&snapshot->right, rightTimes, right, now);
+}
 
-        tempLeftNotchCount = 0;
+/*!
+ * @brief Interpolates a wheel position between its last two encoder edges.
+ *
+ * @param[in] wheel Edges of the wheel.
+ * @param[in] time_us Time to estimate the position at, in microseconds since boot.
+ * @return Position in 1/ENCODER_POSITION_SCALE notch units.
+ */
+static uint32_t positionAt(const struct wheelEdges *wheel, uint64_t time_us) {
+    uint32_t times[2];
+    uint32_t notches = copyEdges(wheel, times, 2);
+    uint32_t position = notches * ENCODER_POSITION_SCALE;
+
+    if (notches < 2 || times[0] == times[1]) {
+        return position;
+    }
+
+    // Very long gaps mean the wheel is stopped; capping keeps the maths in 32 bits
+    uint32_t period = times[0] - times[1];
+    if (period > ENCODER_MAX_PERIOD_US) {
+        period = ENCODER_MAX_PERIOD_US;
+    }
+
+    // Signed 32-bit differences stay correct across the timer wrap
+    int32_t sinceLast = (int32_t)((uint32_t)time_us - times[0]);
+    int32_t sincePrev = (int32_t)((uint32_t)time_us - times[1]);
+
+    if (sinceLast >= 0) {
+        // The next edge has not arrived, so the wheel is at most one notch further
+        uint32_t since = (uint32_t)sinceLast > period ? period : (uint32_t)sinceLast;
+        return position + since * ENCODER_POSITION_SCALE / period;
     }
+
+    if (sincePrev >= 0) {
+        uint32_t before = (uint32_t)-sinceLast;
+        return position - before * ENCODER_POSITION_SCALE / period;
+    }
+
+    return position - ENCODER_POSITION_SCALE;
 }
 
 /*!
- * @brief Interrupt service routine for the right wheel encoder.
- *        Increments the notch count and calculates the speed of the right wheel.
+ * @brief Estimates the position of the left wheel at a given time.
  *
- * @param[in] params Optional parameters (unused in this function).
+ * @param[in] time_us Time in microseconds since boot, at most a notch in the past.
+ * @return Position in 1/ENCODER_POSITION_SCALE notch units.
  */
-void rightEncoder(void *params) {
-    // Increment the count of notches detected for the right wheel
-    rightNotchCount++;
-    tempRightNotchCount++;
+uint32_t getLeftPositionAt(uint64_t time_us) {
+    return positionAt(&leftEdges, time_us);
+}
 
-    // Calculate the total distance traveled by the right wheel in centimeters
-    rightTotalDistance = (double)rightNotchCount * CM_PER_NOTCH;
-    tempRightTotalDistance = (double)tempRightNotchCount * CM_PER_NOTCH;
+/*!
+ * @brief Estimates the position of the right wheel at a given time.
+ *
+ * @param[in] time_us Time in microseconds since boot, at most a notch in the past.
+ * @return Position in 1/ENCODER_POSITION_SCALE notch units.
+ */
+uint32_t getRightPositionAt(uint64_t time_us) {
+    return positionAt(&rightEdges, time_us);
+}
 
-    // Calculate speed traveled after every cycle for the right wheel
-    if (tempRightNotchCount % NOTCHES_PER_CYCLE == 0) {
+#if ENCODER_BACKEND == ENCODER_BACKEND_PIO
+/*!
+ * @brief Starts timestamping one wheel's edges with a PIO state machine and DMA.
+ *
+ * The state machine is left disabled so both wheels can be started together.
+ *
+ * @param[in] offset Where the encoder_edge program was loaded.
+ * @param[in] pin Encoder input pin.
+ * @param[in] wheel Edges of the wheel, receiving the timestamps.
+ * @return The state machine used.
+ */
+static uint startEdgeMachine(uint offset, uint pin, struct wheelEdges *wheel) {
+    uint sm = pio_claim_unused_sm(ENCODER_PIO, true);
 
-        // Get the current time in microseconds
-        uint64_t currentTime = time_us_64();
+    gpio_init(pin);
+    gpio_set_dir(pin, GPIO_IN);
 
-        // Calculate the time difference between the current and previous notch
-        uint64_t timeDiff = currentTime - rightLastNotchTime;
+    pio_sm_config config = encoder_edge_program_get_default_config(offset);
+    sm_config_set_jmp_pin(&config, pin);
+    sm_config_set_in_shift(&config, false, true, 32);
+    sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv(&config, (float)clock_get_hz(clk_sys) / ENCODER_PIO_HZ);
 
-        if (timeDiff > 0) {
-            // Calculate speed (distance traveled in 1 second) for the right wheel
-            rightEncoderSpeed = tempRightTotalDistance * 1e6 / timeDiff;
-        }
+    // Enter the loop that matches the pin so no edge is pushed at start-up
+    uint start = offset + (gpio_get(pin) ? encoder_edge_offset_high : encoder_edge_offset_low);
+    pio_sm_init(ENCODER_PIO, sm, start, &config);
+    pio_sm_exec(ENCODER_PIO, sm, pio_encode_set(pio_x, 0));
 
-        // Update the last notch time for the right wheel
-        rightLastNotchTime = currentTime;
+    // Drain the RX FIFO into the edge ring forever, without interrupts
+    wheel->dmaChannel = dma_claim_unused_channel(true);
+    dma_channel_config dma = dma_channel_get_default_config(wheel->dmaChannel);
+    channel_config_set_transfer_data_size(&dma, DMA_SIZE_32);
+    channel_config_set_read_increment(&dma, false);
+    channel_config_set_write_increment(&dma, true);
+    channel_config_set_ring(&dma, true, ENCODER_EDGE_RING_BITS + 2);
+    channel_config_set_dreq(&dma, pio_get_dreq(ENCODER_PIO, sm, false));
+    dma_channel_configure(wheel->dmaChannel, &dma, wheel->times, &ENCODER_PIO->rxf[sm],
+                          ENCODER_DMA_TRANSFERS, true);
 
-        tempRightNotchCount = 0;
-    }
+    return sm;
+}
+
+/*!
+ * @brief Initializes the wheel encoders: one PIO state machine and DMA channel per wheel.
+ *
+ * @param[in] params Optional parameters (unused in this function).
+ */
+void initEncoder(void *params) {
+    uint offset = pio_add_program(ENCODER_PIO, &encoder_edge_program);
+    uint leftSm = startEdgeMachine(offset, LEFT_ENCODER_PIN, &leftEdges);
+    uint rightSm = startEdgeMachine(offset, RIGHT_ENCODER_PIN, &rightEdges);
+
+    pioStartUs = time_us_32();
+    pio_enable_sm_mask_in_sync(ENCODER_PIO, (1u << leftSm) | (1u << rightSm));
+}
+#else
+/*!
+ * @brief Initializes the wheel encoder pins; edges arrive through leftEncoder()
+ *        and rightEncoder() from the GPIO IRQ.
+ *
+ * @param[in] params Optional parameters (unused in this function).
+ */
+void initEncoder(void *params) {
+    gpio_init(LEFT_ENCODER_PIN);
+    gpio_set_dir(LEFT_ENCODER_PIN, GPIO_IN);
+    gpio_init(RIGHT_ENCODER_PIN);
+    gpio_set_dir(RIGHT_ENCODER_PIN, GPIO_IN);
+}
+
+/*!
+ * @brief Records one encoder edge: its time, then the new count.
+ *
+ * Integer stores only, so it costs a few cycles inside the GPIO IRQ. The count is
+ * written last, so a reader that sees it also sees the edge time.
+ *
+ * @param[in] wheel Edges of the wheel that moved.
+ */
+static inline void recordEdge(struct wheelEdges *wheel) {
+    uint32_t count = wheel->count;
+
+    wheel->times[count & ENCODER_EDGE_RING_MASK] = time_us_32();
+    wheel->count = count + 1;
+}
+
+/*!
+ * @brief Interrupt service routine for the left wheel encoder.
+ *        Records the edge; distance and speed are computed when read.
+ *
+ * @param[in] params Optional parameters (unused in this function).
+ */
+void leftEncoder(void *params) {
+    recordEdge(&leftEdges);
+}
+
+/*!
+ * @brief Interrupt service routine for the right wheel encoder.
+ *        Records the edge; distance and speed are computed when read.
+ *
+ * @param[in] params Optional parameters (unused in this function).
+ */
+void rightEncoder(void *params) {
+    recordEdge(&rightEdges);
 }
 
+#endif
+
 /*** End of file ***/
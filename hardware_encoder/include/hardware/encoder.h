@@ -8,19 +8,67 @@
 #ifndef _ENCODER_H
 #define _ENCODER_H
 
+#include <stdint.h>
+
 // Definitions for encoder GPIO pins and constants for calculations
 #define LEFT_ENCODER_PIN 16
 #define RIGHT_ENCODER_PIN 17
-#define NOTCHES_PER_CYCLE 20
-#define CM_PER_NOTCH 1.0
+#define NOTCHES_PER_CYCLE 20            // Most intervals the speed window averages over
+#define ENCODER_UM_PER_NOTCH 10000      // Distance per notch in micrometres (1 cm)
+#define CM_PER_NOTCH (ENCODER_UM_PER_NOTCH / 10000.0)
+#define ENCODER_SPEED_FRACTION_BITS 16  // Fixed-point speeds are cm/s in Q16
+#define ENCODER_EDGE_RING_BITS 5
+#define ENCODER_EDGE_RING_SIZE (1 << ENCODER_EDGE_RING_BITS)  // Edge times kept per wheel, above NOTCHES_PER_CYCLE
+#define ENCODER_EDGE_RING_MASK (ENCODER_EDGE_RING_SIZE - 1)
+#define ENCODER_POSITION_SCALE 256      // Interpolated positions are in 1/256 notch
+#define ENCODER_MAX_PERIOD_US 8000000   // Edge gaps longer than this count as stopped
+#define ENCODER_SPEED_WINDOW_US 100000  // Edge intervals averaged for speed must end within this
+#define ENCODER_STOP_US 500000          // No edge for this long reads as zero speed
+#define ENCODER_MAX_SPEED_CM_S 500      // Speeds are capped here, so contact bounce cannot read as any speed
+
+// Edge capture backends: the GPIO IRQ calls leftEncoder()/rightEncoder() on every
+// edge, or a PIO state machine per wheel timestamps edges and DMA stores them
+#define ENCODER_BACKEND_IRQ 0
+#define ENCODER_BACKEND_PIO 1
+#ifndef ENCODER_BACKEND
+#define ENCODER_BACKEND ENCODER_BACKEND_IRQ
+#endif
+#define ENCODER_PIO pio0
+#define ENCODER_PIO_HZ 4000000          // 4 cycles per loop in encoder.pio, so X ticks every 1 us
+#define ENCODER_DMA_TRANSFERS 0xFFFFFFFFu  // Edges the DMA channel can store before it stops
+
+// State of one wheel at the time of a snapshot
+typedef struct {
+    uint32_t count;         // Edges seen since start-up
+    uint32_t distance;      // Distance travelled in millimetres
+    uint32_t speed;         // Speed in cm/s, Q16 fixed point
+    uint32_t lastEdgeUs;    // Time of the newest edge, 32-bit microseconds since boot (0 if none)
+} encoder_wheel_state_t;
+
+// Both wheels at one instant
+typedef struct {
+    uint32_t time_us;       // When the snapshot was taken, 32-bit microseconds since boot
+    encoder_wheel_state_t left;
+    encoder_wheel_state_t right;
+} encoder_snapshot_t;
 
 // Function declarations for encoder operations
+void initEncoder(void *params);
+#if ENCODER_BACKEND == ENCODER_BACKEND_IRQ
 void leftEncoder(void *params);
 void rightEncoder(void *params);
+#endif
 double getLeftSpeed(void *params);
 double getRightSpeed(void *params);
+uint32_t getLeftSpeedFixed(void *params);
+uint32_t getRightSpeedFixed(void *params);
 uint32_t getLeftNotchCount(void *params);
 uint32_t getRightNotchCount(void *params);
+uint32_t getLeftDistance(void *params);
+uint32_t getRightDistance(void *params);
+uint32_t getLeftPositionAt(uint64_t time_us);
+uint32_t getRightPositionAt(uint64_t time_us);
+void encoder_get_snapshot(encoder_snapshot_t *snapshot);
 
 
 #endif /* _ENCODER_H */
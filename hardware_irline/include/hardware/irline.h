@@ -14,6 +14,10 @@
 #ifndef _IRLINE_H
 #define _IRLINE_H
 
+#include <stdint.h>
+
+#include "hardware/threshold.h"
+
 // Define GPIO pins for IR sensors and their respective ground pins
 #define LEFT_IR_SENSOR_A0 26
 #define LEFT_IR_SENSOR_GND 3
@@ -21,7 +25,9 @@
 #define RIGHT_IR_SENSOR_GND 5
 
 // Constants for color differentiation and pulse width timeout
-#define COLOUR_CUTOFF_VALUE 1000 // Color difference between black and white. Use IR sensor to measure.
+#define IR_WHITE_LEVEL 400             // Starting levels until the thresholds have adapted,
+#define IR_BLACK_LEVEL 1600            // centred on the old fixed cut-off of 1000
+#define IR_THRESHOLD_DECAY_SHIFT 8     // Levels forget over 256 readings, about 2.5 s at 10 ms
 #define PULSE_WIDTH_TIMEOUT 1000
 
 // Function prototypes for IR sensor setup and reading functions
@@ -29,6 +35,10 @@ void ir_setup(void *params);
 void read_ir(void *params);
 uint32_t getLeftIRSensorValue(void *params);
 uint32_t getRightIRSensorValue(void *params);
+int isLeftIRBlack(void *params);
+int isRightIRBlack(void *params);
+void getLeftIRLevels(threshold_levels_t *levels);
+void getRightIRLevels(threshold_levels_t *levels);
 
 #endif
 
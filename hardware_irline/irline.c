@@ -6,7 +6,8 @@
  * This module contains the implementations necessary for initializing and using IR sensors.
  * It includes functions for setting up the sensors, reading sensor values, and calculating
  * IR pulse widths. The module handles GPIO and ADC configurations specific to the
- * Raspberry Pi Pico platform.
+ * Raspberry Pi Pico platform. Each sensor classifies its readings as black or white
+ * with its own adaptive threshold, so line following survives lighting changes.
  *
  */
 
@@ -24,6 +25,7 @@
 #include "hardware/adc.h"
 #include "hardware/gpio.h"
 #include "hardware/irline.h"
+#include "hardware/threshold.h"
 
 volatile uint32_t l_ir_result;
 volatile uint32_t r_ir_result;
@@ -31,6 +33,12 @@ volatile uint64_t ir_pulse_width;
 volatile absolute_time_t start_time_ir;
 volatile absolute_time_t end_time_ir;
 
+// Adaptive black/white thresholds and the latest colour of each sensor
+static threshold_t leftThreshold;
+static threshold_t rightThreshold;
+static volatile int leftIRBlack = 0;
+static volatile int rightIRBlack = 0;
+
 // Function to read IR sensor values and calculate pulse width
 void read_ir(void *params) {
     // Read ADC values from left and right IR sensors
@@ -38,6 +46,9 @@ void read_ir(void *params) {
     l_ir_result = adc_read();
     adc_select_input(1);
     r_ir_result = adc_read();
+
+    leftIRBlack = threshold_update(&leftThreshold, l_ir_result);
+    rightIRBlack = threshold_update(&rightThreshold, r_ir_result);
 }
 
 uint32_t getLeftIRSensorValue(void *params) {
@@ -48,8 +59,31 @@ uint32_t getRightIRSensorValue(void *params) {
     return r_ir_result;
 }
 
+// Check if the left IR sensor is over black
+int isLeftIRBlack(void *params) {
+    return leftIRBlack;
+}
+
+// Check if the right IR sensor is over black
+int isRightIRBlack(void *params) {
+    return rightIRBlack;
+}
+
+// Get the live white/black levels and switching points of the left IR sensor
+void getLeftIRLevels(threshold_levels_t *levels) {
+    threshold_get_levels(&leftThreshold, levels);
+}
+
+// Get the live white/black levels and switching points of the right IR sensor
+void getRightIRLevels(threshold_levels_t *levels) {
+    threshold_get_levels(&rightThreshold, levels);
+}
+
 // Setup function for IR sensors
 void ir_setup(void *params) {
+    threshold_init(&leftThreshold, IR_WHITE_LEVEL, IR_BLACK_LEVEL, IR_THRESHOLD_DECAY_SHIFT);
+    threshold_init(&rightThreshold, IR_WHITE_LEVEL, IR_BLACK_LEVEL, IR_THRESHOLD_DECAY_SHIFT);
+
     // Initialize GPIO pins for IR sensors' GND
     gpio_init(LEFT_IR_SENSOR_GND);
     gpio_init(RIGHT_IR_SENSOR_GND);
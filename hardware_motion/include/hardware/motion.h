@@ -0,0 +1,64 @@
+/**
+ * @file motion.h
+ *
+ * @brief Provides a queue of motion primitives and the task that executes them.
+ *
+ * Callers queue primitives (drive a distance, turn on the spot, drive an arc,
+ * stop) and return at once. The motion task takes them in order, gives the
+ * speed controller each wheel's distance to drive, and sleeps between feedback
+ * checks every MOTION_POLL_MS. Distance comes from the encoders and heading from
+ * odometry. The controller's profiles ease each primitive in and brake it to a
+ * stop at its end. The car stops once the queue runs empty.
+ *
+ * A primitive can name a task to notify when it ends. Its notification value
+ * is then set to MOTION_DONE, or MOTION_CANCELLED if motion_cancel() or an
+ * emergency stop (motor_emergency_stop()) ended it.
+ *
+ */
+
+#ifndef _MOTION_H
+#define _MOTION_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Constants for the motion executor
+#define MOTION_QUEUE_DEPTH 8
+#define MOTION_POLL_MS 10
+
+// Notification values sent when a primitive ends
+#define MOTION_DONE 1
+#define MOTION_CANCELLED 2
+
+// Motion primitives
+typedef enum {
+    MOTION_FORWARD,     // Drive straight for distance (negative: backwards)
+    MOTION_TURN,        // Turn on the spot by angle
+    MOTION_ARC,         // Drive an arc of radius until the heading changed by angle
+    MOTION_STOP         // Stop and wait until both wheels stand still
+} motion_type_t;
+
+// One queued primitive
+typedef struct {
+    motion_type_t type;
+    int32_t distance;       // MOTION_FORWARD: millimetres
+    int32_t angle;          // MOTION_TURN, MOTION_ARC: degrees, positive anticlockwise
+    int32_t radius;         // MOTION_ARC: millimetres from the centre of the car to the turn centre, above half the track
+    float speed;            // cm/s of the car's centre, or of each wheel when turning on the spot
+    TaskHandle_t notify;    // Task to notify when the primitive ends, or NULL
+} motion_t;
+
+void motion_init(void);
+void motion_task(void *params);
+int motion_queue(const motion_t *motion, TickType_t timeout);
+void motion_cancel(void);
+int motion_forward(int32_t distance, float speed, TaskHandle_t notify);
+int motion_turn(int32_t angle, float speed, TaskHandle_t notify);
+int motion_arc(int32_t radius, int32_t angle, float speed, TaskHandle_t notify);
+int motion_stop(TaskHandle_t notify);
+
+#endif
+
+/*** End of file ***/
@@ -0,0 +1,251 @@
+/**
+ * @file motion.c
+ *
+ * @brief Implements the motion primitive queue and its executor task.
+ *
+ * The executor blocks on the queue while idle. While a primitive runs it wakes
+ * every MOTION_POLL_MS to check progress. Turns add up the heading change
+ * between checks, so angles beyond half a turn work too.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "hardware/encoder.h"
+#include "hardware/odometry.h"
+#include "hardware/speed_control.h"
+#include "hardware/motion.h"
+
+// Queue of primitives waiting to run
+static QueueHandle_t motionQueue;
+
+// Bumped by motion_cancel(); a running primitive is cancelled when it changes
+static volatile uint32_t cancelGeneration;
+
+/**
+ * @brief Creates the motion queue. Call once before any task queues motion.
+ */
+void motion_init(void) {
+    motionQueue = xQueueCreate(MOTION_QUEUE_DEPTH, sizeof(motion_t));
+}
+
+/**
+ * @brief Queues a motion primitive.
+ *
+ * @param motion Primitive to run after those already queued.
+ * @param timeout Ticks to wait for room in the queue.
+ * @return 1 if queued, 0 if the queue stayed full.
+ */
+int motion_queue(const motion_t *motion, TickType_t timeout) {
+    return xQueueSend(motionQueue, motion, timeout) == pdTRUE;
+}
+
+/**
+ * @brief Stops the car now and drops every queued primitive.
+ *
+ * The running primitive ends with MOTION_CANCELLED at the executor's next check.
+ * Queued primitives are dropped without a notification.
+ */
+void motion_cancel(void) {
+    xQueueReset(motionQueue);
+    cancelGeneration++;
+    motor_set_target_speed(0, 0);
+}
+
+/**
+ * @brief Queues driving straight.
+ *
+ * @param distance Millimetres, negative to reverse.
+ * @param speed Speed in cm/s.
+ * @param notify Task to notify at the end, or NULL.
+ * @return 1 if queued, 0 if the queue is full.
+ */
+int motion_forward(int32_t distance, float speed, TaskHandle_t notify) {
+    motion_t motion = {.type = MOTION_FORWARD, .distance = distance, .speed = speed, .notify = notify};
+    return motion_queue(&motion, 0);
+}
+
+/**
+ * @brief Queues turning on the spot.
+ *
+ * @param angle Degrees, positive anticlockwise.
+ * @param speed Wheel speed in cm/s.
+ * @param notify Task to notify at the end, or NULL.
+ * @return 1 if queued, 0 if the queue is full.
+ */
+int motion_turn(int32_t angle, float speed, TaskHandle_t notify) {
+    motion_t motion = {.type = MOTION_TURN, .angle = angle, .speed = speed, .notify = notify};
+    return motion_queue(&motion, 0);
+}
+
+/**
+ * @brief Queues driving an arc.
+ *
+ * @param radius Millimetres from the centre of the car to the turn centre.
+ * @param angle Heading change in degrees, positive anticlockwise (turn centre on the left).
+ * @param speed Speed of the car's centre in cm/s.
+ * @param notify Task to notify at the end, or NULL.
+ * @return 1 if queued, 0 if the queue is full.
+ */
+int motion_arc(int32_t radius, int32_t angle, float speed, TaskHandle_t notify) {
+    motion_t motion = {.type = MOTION_ARC, .angle = angle, .radius = radius, .speed = speed, .notify = notify};
+    return motion_queue(&motion, 0);
+}
+
+/**
+ * @brief Queues stopping until both wheels stand still.
+ *
+ * @param notify Task to notify at the end, or NULL.
+ * @return 1 if queued, 0 if the queue is full.
+ */
+int motion_stop(TaskHandle_t notify) {
+    motion_t motion = {.type = MOTION_STOP, .notify = notify};
+    return motion_queue(&motion, 0);
+}
+
+/**
+ * @brief Gives the speed controller the wheel distances or speeds for a primitive.
+ *
+ * @param motion Primitive being started.
+ * @return 0, or -1 if an emergency stop dropped the targets.
+ */
+static int startMotion(const motion_t *motion) {
+    float halfTrack = ODOMETRY_TRACK_UM / 2000.0f;
+    float radians = motion->angle * 3.14159265f / 180.0f;
+
+    switch (motion->type) {
+    case MOTION_FORWARD:
+        return motor_set_target_distance(motion->distance, motion->distance, motion->speed);
+
+    case MOTION_TURN: {
+        // Each wheel drives its share of the turn around the middle of the axle
+        int32_t wheel = (int32_t)(radians * halfTrack);
+        return motor_set_target_distance(-wheel, wheel, motion->speed);
+    }
+
+    case MOTION_ARC: {
+        // Wheel paths in proportion to their distance from the turn centre; the
+        // outer wheel goes faster than the centre of the car
+        float inner = (motion->radius - halfTrack) * (radians < 0 ? -radians : radians);
+        float outer = (motion->radius + halfTrack) * (radians < 0 ? -radians : radians);
+        float speed = motion->speed * (motion->radius + halfTrack) / motion->radius;
+
+        if (motion->angle < 0) {
+            return motor_set_target_distance((int32_t)outer, (int32_t)inner, speed);
+        }
+        return motor_set_target_distance((int32_t)inner, (int32_t)outer, speed);
+    }
+
+    case MOTION_STOP:
+    default:
+        // An emergency stop has stopped the wheels already
+        motor_set_target_speed(0, 0);
+        return 0;
+    }
+}
+
+/**
+ * @brief Runs one primitive until its feedback says it is done or it is cancelled.
+ *
+ * @param motion Primitive to run.
+ * @param generation cancelGeneration when the primitive was taken off the queue.
+ * @return MOTION_DONE or MOTION_CANCELLED.
+ */
+static uint32_t runMotion(const motion_t *motion, uint32_t generation) {
+    encoder_snapshot_t start;
+    encoder_snapshot_t encoders;
+    odometry_pose_t pose;
+
+    encoder_get_snapshot(&start);
+    odometry_get_pose(&pose);
+
+    uint32_t lastTheta = pose.theta;
+    int64_t turned = 0;     // Binary angle units, any number of turns
+    int64_t targetAngle = ((int64_t)motion->angle << 32) / 360;
+    uint64_t targetTravel = (uint64_t)(motion->distance < 0 ? -motion->distance : motion->distance) * 1000;
+
+    // While an emergency stop is latched the wheels do not move, and the halted
+    // profile would read as reached
+    if (startMotion(motion) != 0) {
+        return MOTION_CANCELLED;
+    }
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(MOTION_POLL_MS));
+
+        if (cancelGeneration != generation || motor_emergency_latched()) {
+            return MOTION_CANCELLED;
+        }
+
+        encoder_get_snapshot(&encoders);
+        odometry_get_pose(&pose);
+        turned += (int32_t)(pose.theta - lastTheta);
+        lastTheta = pose.theta;
+
+        switch (motion->type) {
+        case MOTION_FORWARD: {
+            // Mean notches of both wheels
+            uint32_t notches = ((encoders.left.count - start.left.count) +
+                                (encoders.right.count - start.right.count)) / 2;
+
+            // The profile brakes to a stop at the distance; done once either says so
+            if ((uint64_t)notches * ENCODER_UM_PER_NOTCH >= targetTravel || motor_target_reached()) {
+                return MOTION_DONE;
+            }
+            break;
+        }
+
+        case MOTION_TURN:
+        case MOTION_ARC:
+            if (targetAngle < 0 ? turned <= targetAngle : turned >= targetAngle) {
+                return MOTION_DONE;
+            }
+
+            // Wheel slip can leave the heading short when the profile has stopped
+            if (motor_target_reached()) {
+                return MOTION_DONE;
+            }
+            break;
+
+        case MOTION_STOP:
+        default:
+            if (encoders.left.speed == 0 && encoders.right.speed == 0) {
+                return MOTION_DONE;
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Task running queued motion primitives in order.
+ *
+ * @param params Task parameters (unused).
+ */
+void motion_task(void *params) {
+    motion_t motion;
+
+    while (true) {
+        if (xQueueReceive(motionQueue, &motion, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        uint32_t result = runMotion(&motion, cancelGeneration);
+
+        // Hand over to the next primitive without stopping, or stop if there is none
+        if (result != MOTION_DONE || uxQueueMessagesWaiting(motionQueue) == 0) {
+            motor_set_target_speed(0, 0);
+        }
+
+        if (motion.notify != NULL) {
+            xTaskNotify(motion.notify, result, eSetValueWithOverwrite);
+        }
+    }
+}
+
+/*** End of file ***/
@@ -8,6 +8,8 @@
 #ifndef _MOTOR_H
 #define _MOTOR_H
 
+#include <stdint.h>
+
 // Definitions of GPIO pins for motor control
 #define LEFT_WHEEL 14
 #define RIGHT_WHEEL 15
@@ -20,8 +22,13 @@
 #define CLK_DIV 100
 #define PWM_WRAP 12500
 
+// Wheel directions, as signs of travel
+#define MOTOR_FORWARD 1
+#define MOTOR_BACKWARD -1
+
 // Function declarations for motor control
 void initMotor(void *params);
+void motor_set_duty(int32_t left, int32_t right);
 void setLeftSpeed(float speed_multiplier);
 void increaseLeftSpeed(void *params);
 void decreaseLeftSpeed(void *params);
@@ -33,6 +40,10 @@ void moveForward(void *params);
 void moveBackward(void *params);
 void turnHardLeft(void *params);
 void turnHardRight(void *params);
+int getLeftDirection(void *params);
+int getRightDirection(void *params);
+void setLeftDirection(int direction);
+void setRightDirection(int direction);
 
 #endif /* _MOTOR_H */
 
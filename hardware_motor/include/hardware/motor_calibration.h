@@ -0,0 +1,69 @@
+/**
+ * @file motor_calibration.h
+ *
+ * @brief Provides motor characterization and the feedforward map kept in flash.
+ *
+ * motor_calibrate() sweeps both wheels' PWM level from rest to PWM_WRAP, records
+ * each wheel's steady encoder speed at every step and the lowest level that
+ * starts it from rest (deadband), and fits a straight line of level against
+ * speed above the deadband. The line is the speed controller's feedforward, so
+ * it starts each wheel near the right level instead of winding the integral up
+ * to make up the difference between the two motors.
+ *
+ * The result is kept in the last sector of flash, which the program must not
+ * reach, with a magic number, a version and a CRC-32. initMotor() loads it at
+ * boot; without a valid record the gains in speed_control.h are used.
+ *
+ * Run the sweep with the car on a stand, or with a few metres clear in front:
+ * both wheels drive forwards, up to full speed, for about
+ * MOTOR_CALIBRATION_STEPS * MOTOR_CALIBRATION_SETTLE_MS.
+ *
+ */
+
+#ifndef _MOTOR_CALIBRATION_H
+#define _MOTOR_CALIBRATION_H
+
+#include <stdint.h>
+
+// Set to 1 to sweep and save a new map each time the car starts
+#ifndef MOTOR_CALIBRATE_AT_BOOT
+#define MOTOR_CALIBRATE_AT_BOOT 0
+#endif
+
+// Constants for the sweep
+#define MOTOR_CALIBRATION_STEPS 24          // Levels from PWM_WRAP / STEPS up to PWM_WRAP
+#define MOTOR_CALIBRATION_SETTLE_MS 400     // Time for a wheel to reach its speed after a step
+#define MOTOR_CALIBRATION_MEASURE_MS 300    // Time the speed is averaged over
+#define MOTOR_CALIBRATION_REFINE_STEPS 8    // Steps the deadband is searched in between two levels
+
+// Record in flash
+#define MOTOR_CALIBRATION_MAGIC 0x4C41434Du // "MCAL"
+#define MOTOR_CALIBRATION_VERSION 1
+#define MOTOR_CALIBRATION_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+// Characterization of one wheel
+typedef struct {
+    uint16_t deadband;      // Lowest PWM level that starts the wheel from rest
+    uint16_t points;        // Steps the fit used
+    int32_t ffSlope;        // Fitted PWM levels per cm/s, Q8 (motor_gains_t.ffSlope)
+    int32_t ffOffset;       // Fitted PWM level at 0 cm/s while turning (motor_gains_t.ffOffset)
+    int32_t maxSpeed;       // Speed at PWM_WRAP, cm/s Q16
+    int32_t speed[MOTOR_CALIBRATION_STEPS];  // Steady speed at each step, cm/s Q16
+} motor_wheel_calibration_t;
+
+// Record kept in flash
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    motor_wheel_calibration_t wheel[2];     // Indexed by MOTOR_LEFT and MOTOR_RIGHT
+    uint32_t crc;                           // CRC-32 of everything before it
+} motor_calibration_t;
+
+int motor_calibrate(motor_calibration_t *calibration);
+int motor_calibration_save(motor_calibration_t *calibration);
+const motor_calibration_t *motor_calibration_stored(void);
+void motor_calibration_apply(const motor_calibration_t *calibration);
+
+#endif
+
+/*** End of file ***/
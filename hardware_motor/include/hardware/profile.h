@@ -0,0 +1,48 @@
+/**
+ * @file profile.h
+ *
+ * @brief Provides acceleration- and jerk-limited speed profiles for one wheel.
+ *
+ * A profile turns a commanded speed, or a distance to cover at a cruise speed,
+ * into a setpoint that changes a little every control tick. With maxJerk 0 the
+ * setpoint ramps at maxAccel (trapezoidal profile). Otherwise the acceleration
+ * itself ramps at maxJerk (S-curve), easing in and out of every speed change.
+ * The limits hold between consecutive setpoints, not just on average; the one
+ * exception is a stop that comes too late to ease into, which ends at zero
+ * speed at once rather than reversing the wheel.
+ * In distance mode the setpoint brakes in time to reach zero speed as the
+ * distance runs out.
+ *
+ * Speeds are cm/s, accelerations cm/s^2, jerks cm/s^3 and distances cm, all Q16.
+ * Setpoints are signed, negative for backwards. Steps are integer only, for use
+ * in the controller's timer interrupt. The module only depends on the C standard
+ * headers.
+ *
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdint.h>
+
+// State of one wheel's profile
+typedef struct {
+    int32_t velocity;       // Current setpoint
+    int32_t acceleration;   // Current rate of change of the setpoint
+    int32_t target;         // Speed to reach, or cruise speed in distance mode
+    int64_t remaining;      // Distance mode: distance still to cover
+    int32_t maxAccel;
+    int32_t maxJerk;        // 0 for a trapezoidal profile
+    uint8_t distanceMode;
+    uint8_t done;           // Distance mode: distance covered and stopped
+} motor_profile_t;
+
+void motor_profile_init(motor_profile_t *profile, int32_t maxAccel, int32_t maxJerk);
+void motor_profile_set_speed(motor_profile_t *profile, int32_t target);
+void motor_profile_set_distance(motor_profile_t *profile, int64_t distance, int32_t speed);
+void motor_profile_set_limits(motor_profile_t *profile, int32_t maxAccel, int32_t maxJerk);
+int32_t motor_profile_step(motor_profile_t *profile, uint32_t hz);
+
+#endif
+
+/*** End of file ***/
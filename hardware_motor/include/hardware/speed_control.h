@@ -0,0 +1,77 @@
+/**
+ * @file speed_control.h
+ *
+ * @brief Provides closed-loop wheel speed control in cm/s.
+ *
+ * Each wheel has a PID controller with feedforward. A repeating hardware timer
+ * ticks both at MOTOR_CONTROL_HZ. Every tick takes one encoder snapshot, so both
+ * wheels are compared at the same instant, and writes both PWM levels. The
+ * feedforward puts the level close to where the wheel needs it, and PID trims
+ * the rest. The integral stops growing while the output is saturated in the
+ * direction of the error (anti-windup), so it does not overshoot when the load
+ * comes off.
+ *
+ * Targets are signed: the sign sets the H-bridge direction and the controller
+ * works on the magnitude, since the encoders cannot tell direction. All tick
+ * maths is integer, as the RP2040 has no FPU.
+ *
+ * Setpoints never jump to a new target. A profile per wheel (see profile.h)
+ * ramps them within MOTOR_MAX_ACCEL and MOTOR_MAX_JERK, or drives a distance
+ * and brakes to a stop at its end.
+ *
+ * motor_emergency_stop() skips all of that: it cuts the PWM at once and holds
+ * the wheels stopped, whatever the targets, until motor_emergency_release().
+ *
+ */
+
+#ifndef _SPEED_CONTROL_H
+#define _SPEED_CONTROL_H
+
+#include <stdint.h>
+
+// Controller rate
+#define MOTOR_CONTROL_HZ 100
+
+// Gains are Q8: 256 is one PWM level per cm/s (kp, feedforward slope), per cm/s
+// per second of error (ki) or per cm/s^2 of speed change (kd)
+#define MOTOR_GAIN_FRACTION_BITS 8
+#define MOTOR_KP (120 << MOTOR_GAIN_FRACTION_BITS)
+#define MOTOR_KI (800 << MOTOR_GAIN_FRACTION_BITS)
+#define MOTOR_KD 0
+#define MOTOR_FF_SLOPE (150 << MOTOR_GAIN_FRACTION_BITS)
+#define MOTOR_FF_OFFSET 3000            // Level that just overcomes friction
+#define MOTOR_INTEGRAL_LIMIT 4000       // Most PWM levels the integral may contribute
+
+// Profile limits: cm/s^2, and cm/s^3 (0 for trapezoidal ramps)
+#define MOTOR_MAX_ACCEL 60.0f
+#define MOTOR_MAX_JERK 300.0f
+
+// Wheels
+#define MOTOR_LEFT 0
+#define MOTOR_RIGHT 1
+
+// Gains of one wheel's controller
+typedef struct {
+    int32_t kp;
+    int32_t ki;
+    int32_t kd;
+    int32_t ffSlope;        // PWM levels per cm/s of target, Q8
+    int32_t ffOffset;       // PWM level added to any non-zero target
+} motor_gains_t;
+
+void motor_speed_control_start(void);
+int motor_speed_control_stop(void);
+int motor_set_target_speed(float left, float right);
+int motor_set_target_distance(int32_t left, int32_t right, float speed);
+void motor_halt(void);
+void motor_emergency_stop(void);
+void motor_emergency_release(void);
+int motor_emergency_latched(void);
+void motor_set_profile_limits(float accel, float jerk);
+int motor_target_reached(void);
+void motor_set_gains(int wheel, const motor_gains_t *gains);
+void motor_get_gains(int wheel, motor_gains_t *gains);
+
+#endif
+
+/*** End of file ***/
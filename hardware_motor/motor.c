@@ -6,17 +6,29 @@
 
 #include <stdio.h>
 #include "hardware/motor.h"
+#include "hardware/motor_calibration.h"
 #include "hardware/gpio.h"
 #include "hardware/pwm.h"
 
-// Global variables to store measurement data
-uint slice_num_left;
-uint slice_num_right;
-volatile int left_level = 0;
-volatile int right_level = 0;
+// Both wheels are the two channels of one PWM slice, so one compare register
+// write updates both and they latch together at the end of the PWM period
+#define MOTOR_PWM_SLICE ((LEFT_WHEEL >> 1) & 7u)
+_Static_assert(((RIGHT_WHEEL >> 1) & 7u) == MOTOR_PWM_SLICE, "wheels must share a PWM slice");
+_Static_assert((LEFT_WHEEL & 1) == PWM_CHAN_A, "left wheel must be PWM channel A");
+
+// PWM levels last written, so unchanged updates cost no register write
+volatile uint16_t left_level = 0;
+volatile uint16_t right_level = 0;
+
+// Direction each wheel was last driven in, for odometry (the encoders cannot tell)
+volatile int left_direction = MOTOR_FORWARD;
+volatile int right_direction = MOTOR_FORWARD;
 
 /**
- * Initializes the motor control system by configuring GPIO pins and PWM slices.
+ * Initializes the motor control system by configuring GPIO pins and the PWM slice.
+ * The slice's divider and wrap are set once here; afterwards only the compare
+ * levels are written. The feedforward saved by motor_calibration_save() is
+ * loaded here too.
  *
  * @param params Optional parameters (unused in this function).
  */
@@ -25,9 +37,15 @@ void initMotor(void *params) {
     gpio_set_function(LEFT_WHEEL, GPIO_FUNC_PWM);
     gpio_set_function(RIGHT_WHEEL, GPIO_FUNC_PWM);
 
-    // Assigning PWM slice numbers
-    slice_num_left = pwm_gpio_to_slice_num(LEFT_WHEEL);
-    slice_num_right = pwm_gpio_to_slice_num(RIGHT_WHEEL);
+    // Configuring the PWM slice once, both wheels stopped
+    pwm_config config = pwm_get_default_config();
+    pwm_config_set_clkdiv(&config, CLK_DIV);
+    pwm_config_set_wrap(&config, PWM_WRAP);
+    pwm_init(MOTOR_PWM_SLICE, &config, false);
+    pwm_set_both_levels(MOTOR_PWM_SLICE, 0, 0);
+    left_level = 0;
+    right_level = 0;
+    pwm_set_enabled(MOTOR_PWM_SLICE, true);
 
     // Initializing motor control pins
     gpio_init(RIGHT_WHEEL_FORWARD);
@@ -40,6 +58,37 @@ void initMotor(void *params) {
     gpio_set_dir(RIGHT_WHEEL_BACKWARD, GPIO_OUT);
     gpio_set_dir(LEFT_WHEEL_FORWARD, GPIO_OUT);
     gpio_set_dir(LEFT_WHEEL_BACKWARD, GPIO_OUT);
+
+    // Starting the speed controllers from the saved characterization, if there is one
+    const motor_calibration_t *calibration = motor_calibration_stored();
+
+    if (calibration != NULL) {
+        motor_calibration_apply(calibration);
+    }
+}
+
+/**
+ * Sets both motors' duty as PWM levels out of PWM_WRAP.
+ *
+ * A single write to the slice's compare register sets both channels, and the
+ * hardware latches it at the next wrap, so both wheels change in the same PWM
+ * period. Nothing is written if neither level changed. Levels are clamped to
+ * 0 to PWM_WRAP. Safe to call from interrupt context.
+ *
+ * @param left Left level.
+ * @param right Right level.
+ */
+void motor_set_duty(int32_t left, int32_t right) {
+    uint16_t leftLevel = left < 0 ? 0 : left > PWM_WRAP ? PWM_WRAP : (uint16_t)left;
+    uint16_t rightLevel = right < 0 ? 0 : right > PWM_WRAP ? PWM_WRAP : (uint16_t)right;
+
+    if (leftLevel == left_level && rightLevel == right_level) {
+        return;
+    }
+
+    left_level = leftLevel;
+    right_level = rightLevel;
+    pwm_set_both_levels(MOTOR_PWM_SLICE, leftLevel, rightLevel);
 }
 
 /**
@@ -48,11 +97,7 @@ void initMotor(void *params) {
  * @param speed_multiplier Multiplier for PWM duty cycle.
  */
 void setLeftSpeed(float speed_multiplier) {
-    pwm_set_clkdiv(slice_num_left, CLK_DIV);
-    pwm_set_wrap(slice_num_left, PWM_WRAP);
-    pwm_set_chan_level(slice_num_left, PWM_CHAN_A, PWM_WRAP * speed_multiplier);
-    left_level = PWM_WRAP * speed_multiplier;
-    pwm_set_enabled(slice_num_left, true);
+    motor_set_duty(PWM_WRAP * speed_multiplier, right_level);
 }
 
 /**
@@ -61,8 +106,7 @@ void setLeftSpeed(float speed_multiplier) {
  * @param params Optional parameters (unused in this function).
  */
 void increaseLeftSpeed(void *params) {
-    left_level += 7;
-    pwm_set_chan_level(slice_num_left, PWM_CHAN_A, left_level);
+    motor_set_duty(left_level + 7, right_level);
 }
 
 /**
@@ -71,8 +115,7 @@ void increaseLeftSpeed(void *params) {
  * @param params Optional parameters (unused in this function).
  */
 void decreaseLeftSpeed(void *params) {
-    left_level -= 7;
-    pwm_set_chan_level(slice_num_left, PWM_CHAN_A, left_level);
+    motor_set_duty(left_level - 7, right_level);
 }
 
 /**
@@ -81,11 +124,7 @@ void decreaseLeftSpeed(void *params) {
  * @param speed_multiplier Multiplier for PWM duty cycle.
  */
 void setRightSpeed(float speed_multiplier) {
-    pwm_set_clkdiv(slice_num_right, CLK_DIV);
-    pwm_set_wrap(slice_num_right, 10000);
-    pwm_set_chan_level(slice_num_right, PWM_CHAN_B, PWM_WRAP * speed_multiplier);
-    right_level = PWM_WRAP * speed_multiplier;
-    pwm_set_enabled(slice_num_right, true);
+    motor_set_duty(left_level, PWM_WRAP * speed_multiplier);
 }
 
 /**
@@ -94,8 +133,7 @@ void setRightSpeed(float speed_multiplier) {
  * @param params Optional parameters (unused in this function).
  */
 void increaseRightSpeed(void *params) {
-    right_level++;
-    pwm_set_chan_level(slice_num_right, PWM_CHAN_B, right_level);
+    motor_set_duty(left_level, right_level + 1);
 }
 
 /**
@@ -104,12 +142,12 @@ void increaseRightSpeed(void *params) {
  * @param params Optional parameters (unused in this function).
  */
 void decreaseRightSpeed(void *params) {
-    right_level--;
-    pwm_set_chan_level(slice_num_right, PWM_CHAN_B, right_level);
+    motor_set_duty(left_level, right_level - 1);
 }
 
 /**
  * Stops both motors.
+ * The wheel directions are kept, since the wheels coast on the same way.
  *
  * @param params Optional parameters (unused in this function).
  */
@@ -130,6 +168,9 @@ void moveForward(void *params) {
     gpio_put(RIGHT_WHEEL_BACKWARD, 0);
     gpio_put(LEFT_WHEEL_FORWARD, 1);
     gpio_put(LEFT_WHEEL_BACKWARD, 0);
+
+    left_direction = MOTOR_FORWARD;
+    right_direction = MOTOR_FORWARD;
 }
 
 /**
@@ -142,6 +183,9 @@ void moveBackward(void *params) {
     gpio_put(RIGHT_WHEEL_BACKWARD, 1);
     gpio_put(LEFT_WHEEL_FORWARD, 0);
     gpio_put(LEFT_WHEEL_BACKWARD, 1);
+
+    left_direction = MOTOR_BACKWARD;
+    right_direction = MOTOR_BACKWARD;
 }
 
 /**
@@ -154,6 +198,9 @@ void turnHardLeft(void *params) {
     gpio_put(RIGHT_WHEEL_BACKWARD, 0);
     gpio_put(LEFT_WHEEL_FORWARD, 0);
     gpio_put(LEFT_WHEEL_BACKWARD, 1);
+
+    left_direction = MOTOR_BACKWARD;
+    right_direction = MOTOR_FORWARD;
 }
 
 /**
@@ -166,6 +213,51 @@ void turnHardRight(void *params) {
     gpio_put(RIGHT_WHEEL_BACKWARD, 1);
     gpio_put(LEFT_WHEEL_FORWARD, 1);
     gpio_put(LEFT_WHEEL_BACKWARD, 0);
+
+    left_direction = MOTOR_FORWARD;
+    right_direction = MOTOR_BACKWARD;
+}
+
+/**
+ * Drives the left wheel in a direction.
+ *
+ * @param direction MOTOR_FORWARD or MOTOR_BACKWARD.
+ */
+void setLeftDirection(int direction) {
+    gpio_put(LEFT_WHEEL_FORWARD, direction == MOTOR_FORWARD);
+    gpio_put(LEFT_WHEEL_BACKWARD, direction == MOTOR_BACKWARD);
+    left_direction = direction;
+}
+
+/**
+ * Drives the right wheel in a direction.
+ *
+ * @param direction MOTOR_FORWARD or MOTOR_BACKWARD.
+ */
+void setRightDirection(int direction) {
+    gpio_put(RIGHT_WHEEL_FORWARD, direction == MOTOR_FORWARD);
+    gpio_put(RIGHT_WHEEL_BACKWARD, direction == MOTOR_BACKWARD);
+    right_direction = direction;
+}
+
+/**
+ * Gets the direction the left wheel was last driven in.
+ *
+ * @param params Optional parameters (unused in this function).
+ * @return MOTOR_FORWARD or MOTOR_BACKWARD.
+ */
+int getLeftDirection(void *params) {
+    return left_direction;
+}
+
+/**
+ * Gets the direction the right wheel was last driven in.
+ *
+ * @param params Optional parameters (unused in this function).
+ * @return MOTOR_FORWARD or MOTOR_BACKWARD.
+ */
+int getRightDirection(void *params) {
+    return right_direction;
 }
 
 /*** End of file ***/
@@ -0,0 +1,301 @@
+/**
+ * @file motor_calibration.c
+ *
+ * @brief Implements the motor characterization sweep and its record in flash.
+ *
+ * The sweep runs in task context and sleeps between steps, so the rest of the
+ * firmware keeps running; only the speed controller's tick is paused, as it
+ * would fight over the PWM levels. Speeds are measured from encoder counts over
+ * MOTOR_CALIBRATION_MEASURE_MS rather than the encoder's per-cycle speed, to
+ * average out the notch spacing. The fit is float, which is fine for a one-off.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/encoder.h"
+#include "hardware/motor.h"
+#include "hardware/speed_control.h"
+#include "hardware/motor_calibration.h"
+
+// The record is programmed as one page
+_Static_assert(sizeof(motor_calibration_t) <= FLASH_PAGE_SIZE, "calibration record must fit in a flash page");
+
+/**
+ * @brief Computes the CRC-32 (IEEE 802.3) of a buffer.
+ *
+ * Bitwise, as it only runs at boot and after a sweep.
+ *
+ * @param data Buffer.
+ * @param length Length in bytes.
+ * @return CRC-32.
+ */
+static uint32_t crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief Measures both wheels' steady speed at the current PWM levels.
+ *
+ * @param speed Filled with the left and right speeds, cm/s Q16.
+ * @param moved Filled with whether each wheel turned at all, settling included.
+ */
+static void measureSpeeds(int32_t speed[2], int moved[2]) {
+    encoder_snapshot_t before;
+    encoder_snapshot_t after;
+    encoder_snapshot_t settled;
+
+    encoder_get_snapshot(&before);
+    sleep_ms(MOTOR_CALIBRATION_SETTLE_MS);
+    encoder_get_snapshot(&settled);
+    sleep_ms(MOTOR_CALIBRATION_MEASURE_MS);
+    encoder_get_snapshot(&after);
+
+    uint32_t elapsed = after.time_us - settled.time_us;
+    uint32_t notches[2] = {after.left.count - settled.left.count, after.right.count - settled.right.count};
+
+    moved[MOTOR_LEFT] = after.left.count != before.left.count;
+    moved[MOTOR_RIGHT] = after.right.count != before.right.count;
+
+    for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+        // um per us is 100 cm/s
+        speed[w] = elapsed == 0 ? 0 :
+                   (int32_t)((int64_t)notches[w] * ENCODER_UM_PER_NOTCH * (100 << 16) / elapsed);
+    }
+}
+
+/**
+ * @brief Lets both wheels come to rest.
+ */
+static void waitForRest(void) {
+    motor_set_duty(0, 0);
+
+    for (int tries = 0; tries < 10; tries++) {
+        int32_t speed[2];
+        int moved[2];
+        measureSpeeds(speed, moved);
+
+        if (!moved[MOTOR_LEFT] && !moved[MOTOR_RIGHT]) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Fits PWM level against speed over a wheel's moving steps.
+ *
+ * Least squares of level = ffOffset + ffSlope * speed.
+ *
+ * @param wheel Wheel with its sweep speeds and deadband filled in.
+ * @return 0, or -1 if fewer than two steps moved the wheel.
+ */
+static int fitFeedforward(motor_wheel_calibration_t *wheel) {
+    float n = 0, sumSpeed = 0, sumLevel = 0, sumSpeedSquared = 0, sumProduct = 0;
+
+    for (int k = 0; k < MOTOR_CALIBRATION_STEPS; k++) {
+        float level = (float)(k + 1) * PWM_WRAP / MOTOR_CALIBRATION_STEPS;
+        float speed = (float)wheel->speed[k] / (1 << 16);
+
+        if (speed <= 0.0f || level < wheel->deadband) {
+            continue;
+        }
+
+        n += 1;
+        sumSpeed += speed;
+        sumLevel += level;
+        sumSpeedSquared += speed * speed;
+        sumProduct += speed * level;
+    }
+
+    float denominator = n * sumSpeedSquared - sumSpeed * sumSpeed;
+    wheel->points = (uint16_t)n;
+
+    if (n < 2 || denominator <= 0.0f) {
+        return -1;
+    }
+
+    float slope = (n * sumProduct - sumSpeed * sumLevel) / denominator;
+    float offset = (sumLevel - slope * sumSpeed) / n;
+
+    wheel->ffSlope = (int32_t)(slope * (1 << MOTOR_GAIN_FRACTION_BITS) + 0.5f);
+    wheel->ffOffset = offset < 0.0f ? 0 : (int32_t)(offset + 0.5f);
+
+    return 0;
+}
+
+/**
+ * @brief Sweeps both wheels and fits their feedforward.
+ *
+ * Blocks for several seconds, driving both wheels forwards (see
+ * motor_calibration.h). Call from a task after initMotor() and initEncoder().
+ * The speed controller's tick is paused meanwhile, and both wheels are
+ * stopped at the end.
+ *
+ * @param calibration Filled with the result; not saved.
+ * @return 0, or -1 if a wheel did not move enough to fit (check the battery
+ *         and that the wheels can turn).
+ */
+int motor_calibrate(motor_calibration_t *calibration) {
+    int wasRunning = motor_speed_control_stop();
+    int32_t speed[2];
+    int moved[2];
+    uint16_t still[2] = {0, 0};         // Highest step level that did not start the wheel
+    uint16_t started[2] = {0, 0};       // Lowest step level that did
+
+    memset(calibration, 0, sizeof(*calibration));
+    setLeftDirection(MOTOR_FORWARD);
+    setRightDirection(MOTOR_FORWARD);
+    waitForRest();
+
+    // Coarse sweep from rest to full duty
+    for (int k = 0; k < MOTOR_CALIBRATION_STEPS; k++) {
+        uint16_t level = (uint16_t)((k + 1) * PWM_WRAP / MOTOR_CALIBRATION_STEPS);
+        motor_set_duty(level, level);
+        measureSpeeds(speed, moved);
+
+        for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+            calibration->wheel[w].speed[k] = speed[w];
+
+            if (started[w] == 0) {
+                if (moved[w]) {
+                    started[w] = level;
+                }
+                else {
+                    still[w] = level;
+                }
+            }
+        }
+    }
+
+    calibration->wheel[MOTOR_LEFT].maxSpeed = speed[MOTOR_LEFT];
+    calibration->wheel[MOTOR_RIGHT].maxSpeed = speed[MOTOR_RIGHT];
+
+    // Narrow the deadband down between the last still and first moving step,
+    // starting from rest each time, as a turning wheel keeps going below it
+    uint16_t deadband[2] = {started[MOTOR_LEFT], started[MOTOR_RIGHT]};
+    int found[2] = {started[MOTOR_LEFT] == 0, started[MOTOR_RIGHT] == 0};
+    waitForRest();
+
+    for (int i = 1; i < MOTOR_CALIBRATION_REFINE_STEPS && !(found[MOTOR_LEFT] && found[MOTOR_RIGHT]); i++) {
+        int32_t level[2];
+
+        for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+            level[w] = found[w] ? 0 : still[w] + (started[w] - still[w]) * i / MOTOR_CALIBRATION_REFINE_STEPS;
+        }
+
+        motor_set_duty(level[MOTOR_LEFT], level[MOTOR_RIGHT]);
+        measureSpeeds(speed, moved);
+
+        for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+            if (!found[w] && moved[w]) {
+                deadband[w] = (uint16_t)level[w];
+                found[w] = 1;
+            }
+        }
+
+        // Stop a wheel once it has started, so the next step starts the other from rest
+        if (moved[MOTOR_LEFT] || moved[MOTOR_RIGHT]) {
+            waitForRest();
+        }
+    }
+
+    motor_set_duty(0, 0);
+    int result = 0;
+
+    for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+        calibration->wheel[w].deadband = deadband[w];
+
+        if (started[w] == 0 || fitFeedforward(&calibration->wheel[w]) != 0) {
+            result = -1;
+        }
+    }
+
+    if (wasRunning) {
+        motor_speed_control_start();
+    }
+
+    return result;
+}
+
+/**
+ * @brief Writes a characterization to the last sector of flash.
+ *
+ * Fills in the magic number, version and CRC. Interrupts are masked while the
+ * sector is erased and programmed (tens of milliseconds), since nothing may run
+ * from flash meanwhile.
+ *
+ * @param calibration Characterization to keep.
+ * @return 0, or -1 if the flash does not read back the same.
+ */
+int motor_calibration_save(motor_calibration_t *calibration) {
+    static uint8_t page[FLASH_PAGE_SIZE];
+
+    calibration->magic = MOTOR_CALIBRATION_MAGIC;
+    calibration->version = MOTOR_CALIBRATION_VERSION;
+    calibration->crc = crc32((const uint8_t *)calibration, offsetof(motor_calibration_t, crc));
+
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, calibration, sizeof(*calibration));
+
+    uint32_t status = save_and_disable_interrupts();
+    flash_range_erase(MOTOR_CALIBRATION_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(MOTOR_CALIBRATION_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(status);
+
+    const motor_calibration_t *stored = motor_calibration_stored();
+
+    return stored != NULL && memcmp(stored, calibration, sizeof(*calibration)) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Gets the characterization kept in flash.
+ *
+ * @return The record, read in place through XIP, or NULL if there is none or
+ *         it is from another version or corrupt.
+ */
+const motor_calibration_t *motor_calibration_stored(void) {
+    const motor_calibration_t *stored = (const motor_calibration_t *)(XIP_BASE + MOTOR_CALIBRATION_OFFSET);
+
+    if (stored->magic != MOTOR_CALIBRATION_MAGIC || stored->version != MOTOR_CALIBRATION_VERSION ||
+        stored->crc != crc32((const uint8_t *)stored, offsetof(motor_calibration_t, crc))) {
+        return NULL;
+    }
+
+    return stored;
+}
+
+/**
+ * @brief Uses a characterization as both wheels' feedforward.
+ *
+ * Only the feedforward changes; the PID gains are kept. Like
+ * motor_set_gains(), call before motor_speed_control_start() or while the
+ * targets are zero.
+ *
+ * @param calibration Characterization to use.
+ */
+void motor_calibration_apply(const motor_calibration_t *calibration) {
+    for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+        motor_gains_t gains;
+        motor_get_gains(w, &gains);
+        gains.ffSlope = calibration->wheel[w].ffSlope;
+        gains.ffOffset = calibration->wheel[w].ffOffset;
+        motor_set_gains(w, &gains);
+    }
+}
+
+/*** End of file ***/
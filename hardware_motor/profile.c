@@ -0,0 +1,279 @@
+/**
+ * @file profile.c
+ *
+ * @brief Implements the acceleration- and jerk-limited speed profiles.
+ *
+ * Each step picks the speed the profile is heading for: the target, or zero
+ * once the distance left is down to the stopping distance. The setpoint then
+ * moves towards it. A trapezoidal profile moves it by at most maxAccel per
+ * second. An S-curve profile moves the acceleration by at most maxJerk per
+ * second instead. It aims for the acceleration it could ease off from, at
+ * maxJerk, in the speed gap left, about sqrt(2 j gap). S-curve steps are
+ * computed as setpoint changes per tick, and the aim is worked out for the
+ * steps actually taken, so the jerk and acceleration between consecutive
+ * setpoints stay within the limits.
+ *
+ */
+
+#include <stdint.h>
+
+#include "hardware/profile.h"
+
+/**
+ * @brief Clamps a value to +/- a limit.
+ */
+static inline int32_t clampMagnitude(int64_t value, int32_t limit) {
+    return value > limit ? limit : value < -limit ? -limit : (int32_t)value;
+}
+
+/**
+ * @brief Gets the integer square root of a value, rounded down.
+ */
+static int64_t squareRoot(int64_t value) {
+    uint64_t remainder = (uint64_t)value;
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > remainder) {
+        bit >>= 2;
+    }
+
+    while (bit != 0) {
+        if (remainder >= root + bit) {
+            remainder -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (int64_t)root;
+}
+
+/**
+ * @brief Gets the largest setpoint change this tick that can still ease off to
+ *        none, one step a tick, within a speed gap.
+ *
+ * Easing off from change c in steps of s covers c + (c - s) + ... + (c - n s),
+ * n being the steps that stay above zero, which is (n + 1) c - s n (n + 1) / 2.
+ * That only grows with c, so the answer is the largest c that fits in the gap.
+ * The continuous estimate, c^2 / 2s + c / 2 = gap, finds n to within one.
+ *
+ * @param gap Speed gap, cm/s Q16, at least 0.
+ * @param step Largest change of the setpoint change per tick (maxJerk / hz^2), above 0.
+ * @return Setpoint change, cm/s Q16 per tick, at least 0.
+ */
+static int64_t easeOffChange(int64_t gap, int64_t step) {
+    int64_t half = step / 2;
+    int64_t estimate = squareRoot(half * half + 2 * step * gap) - half;
+    int64_t best = 0;
+
+    if (estimate < 1) {
+        estimate = 1;
+    }
+
+    int64_t steps = (estimate - 1) / step;
+
+    for (int64_t n = steps > 0 ? steps - 1 : 0; n <= steps + 1; n++) {
+        // Largest change with n steps above zero that fits in the gap
+        int64_t change = (gap + step * n * (n + 1) / 2) / (n + 1);
+
+        if (change > (n + 1) * step) {
+            change = (n + 1) * step;
+        }
+        if (change > n * step && change > best) {
+            best = change;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Starts a profile at rest with no target.
+ *
+ * @param profile Profile to set up.
+ * @param maxAccel Acceleration limit, cm/s^2 Q16, above 0.
+ * @param maxJerk Jerk limit, cm/s^3 Q16, or 0 for a trapezoidal profile.
+ */
+void motor_profile_init(motor_profile_t *profile, int32_t maxAccel, int32_t maxJerk) {
+    profile->velocity = 0;
+    profile->acceleration = 0;
+    profile->target = 0;
+    profile->remaining = 0;
+    profile->distanceMode = 0;
+    profile->done = 1;
+    motor_profile_set_limits(profile, maxAccel, maxJerk);
+}
+
+/**
+ * @brief Changes the acceleration and jerk limits.
+ *
+ * @param profile Profile to change.
+ * @param maxAccel Acceleration limit, cm/s^2 Q16, above 0.
+ * @param maxJerk Jerk limit, cm/s^3 Q16, or 0 for a trapezoidal profile.
+ */
+void motor_profile_set_limits(motor_profile_t *profile, int32_t maxAccel, int32_t maxJerk) {
+    profile->maxAccel = maxAccel;
+    profile->maxJerk = maxJerk;
+}
+
+/**
+ * @brief Ramps towards a speed and holds it.
+ *
+ * @param profile Profile to command.
+ * @param target Speed, cm/s Q16, negative for backwards.
+ */
+void motor_profile_set_speed(motor_profile_t *profile, int32_t target) {
+    profile->target = target;
+    profile->distanceMode = 0;
+    profile->done = 0;
+}
+
+/**
+ * @brief Covers a distance at up to a cruise speed, then stops.
+ *
+ * @param profile Profile to command.
+ * @param distance Distance, cm Q16, at least 0.
+ * @param speed Cruise speed, cm/s Q16, negative for backwards.
+ */
+void motor_profile_set_distance(motor_profile_t *profile, int64_t distance, int32_t speed) {
+    profile->target = speed;
+    profile->remaining = distance;
+    profile->distanceMode = 1;
+    profile->done = distance <= 0;
+}
+
+/**
+ * @brief Gets the distance needed to stop from the current speed and acceleration.
+ *
+ * @param profile Profile.
+ * @return Stopping distance, cm Q16.
+ */
+static int64_t stoppingDistance(const motor_profile_t *profile) {
+    int64_t speed = profile->velocity;
+    int64_t accel = profile->acceleration;
+    int64_t distance = 0;
+
+    // Work with the speed as positive, so braking is negative acceleration
+    if (speed < 0) {
+        speed = -speed;
+        accel = -accel;
+    }
+
+    if (profile->maxJerk != 0 && accel > 0) {
+        // Still speeding up: easing the acceleration off first adds a^2 / 2j of
+        // speed over a / j seconds
+        int64_t eased = speed + accel * accel / (2 * (int64_t)profile->maxJerk);
+        distance += (speed + eased) / 2 * accel / profile->maxJerk;
+        speed = eased;
+    }
+
+    distance += speed * speed / (2 * (int64_t)profile->maxAccel);
+
+    if (profile->maxJerk != 0) {
+        // Easing into and out of the braking costs about another v * a / 2j
+        distance += speed * profile->maxAccel / (2 * (int64_t)profile->maxJerk);
+    }
+
+    return distance;
+}
+
+/**
+ * @brief Advances a profile by one control tick.
+ *
+ * @param profile Profile to advance.
+ * @param hz Control tick rate.
+ * @return New setpoint, cm/s Q16.
+ */
+int32_t motor_profile_step(motor_profile_t *profile, uint32_t hz) {
+    int32_t desired = profile->target;
+
+    if (profile->distanceMode) {
+        int32_t speed = profile->velocity < 0 ? -profile->velocity : profile->velocity;
+        profile->remaining -= speed / hz;
+
+        if (profile->remaining <= stoppingDistance(profile)) {
+            // Braking from here on, even if the estimate later says there is room
+            profile->target = 0;
+            desired = 0;
+        }
+
+        if (profile->remaining <= 0 || (desired == 0 && profile->velocity == 0)) {
+            // Covered (or as close as braking allows): stop and hold
+            profile->remaining = 0;
+            profile->target = 0;
+            profile->done = profile->velocity == 0;
+            desired = 0;
+        }
+    }
+
+    int64_t gap = (int64_t)desired - profile->velocity;
+    int64_t velocity;
+
+    if (profile->maxJerk == 0) {
+        profile->acceleration = clampMagnitude(gap * hz, profile->maxAccel);
+
+        int32_t change = profile->acceleration / (int32_t)hz;
+        velocity = (int64_t)profile->velocity + change;
+
+        // Never step past the desired speed
+        if ((change > 0 && velocity >= desired && profile->velocity <= desired) ||
+            (change < 0 && velocity <= desired && profile->velocity >= desired) || gap == 0) {
+            velocity = desired;
+            profile->acceleration = 0;
+        }
+    }
+    else {
+        // Work in setpoint change per tick, so the limits hold exactly on the
+        // steps taken: the change moves by at most maxJerk / hz^2 a tick
+        int64_t jerkStep = profile->maxJerk / ((int64_t)hz * hz);
+        int64_t accelStep = profile->maxAccel / (int64_t)hz;
+        int64_t previous = profile->acceleration / (int64_t)hz;
+        int64_t change;
+
+        if (jerkStep < 1) {
+            jerkStep = 1;
+        }
+
+        // Land on the desired speed this tick if the limits allow it, and the
+        // change can drop to none next tick
+        if ((gap - previous <= jerkStep && previous - gap <= jerkStep) && (gap <= jerkStep && -gap <= jerkStep) &&
+            (gap <= accelStep && -gap <= accelStep)) {
+            change = gap;
+        }
+        else {
+            int64_t aim = easeOffChange(gap < 0 ? -gap : gap, jerkStep);
+
+            if (aim > accelStep) {
+                aim = accelStep;
+            }
+            if (gap < 0) {
+                aim = -aim;
+            }
+
+            change = clampMagnitude(previous + clampMagnitude(aim - previous, (int32_t)jerkStep), (int32_t)accelStep);
+
+            // Never cross zero on the way to a stop, so the H-bridge is not reversed
+            if (desired == 0 && ((change > 0 && profile->velocity + change > 0 && profile->velocity <= 0) ||
+                                 (change < 0 && profile->velocity + change < 0 && profile->velocity >= 0))) {
+                change = -profile->velocity;
+            }
+        }
+
+        velocity = (int64_t)profile->velocity + change;
+        profile->acceleration = (int32_t)(change * hz);
+    }
+
+    profile->velocity = (int32_t)velocity;
+
+    if (profile->distanceMode && profile->target == 0 && profile->velocity == 0) {
+        profile->done = 1;
+    }
+
+    return profile->velocity;
+}
+
+/*** End of file ***/
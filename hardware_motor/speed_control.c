@@ -0,0 +1,430 @@
+/**
+ * @file speed_control.c
+ *
+ * @brief Implements the per-wheel PID speed controllers and their timer tick.
+ *
+ * Speeds are cm/s in Q16 like the encoder's fixed-point speeds, and outputs are
+ * PWM compare levels (0 to PWM_WRAP), written for both wheels at once. Each tick
+ * first steps both wheels' profiles, then runs PID on the new setpoints.
+ *
+ * Tasks hand commands to the tick through one pending command. Posting one masks
+ * interrupts only while it is copied in, and the tick applies it when its serial
+ * number changes. Gains are written from task context as single words, and the
+ * tick reads each once.
+ *
+ */
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/encoder.h"
+#include "hardware/motor.h"
+#include "hardware/profile.h"
+#include "hardware/speed_control.h"
+
+// Commands posted to the tick
+#define COMMAND_SPEED 0
+#define COMMAND_DISTANCE 1
+#define COMMAND_HALT 2
+
+// Controller state of one wheel
+struct wheelControl {
+    int32_t target;             // Setpoint magnitude from the profile, cm/s Q16
+    int32_t integral;           // PWM levels, Q16
+    int32_t lastSpeed;          // Measured speed at the previous tick, cm/s Q16
+    int drivenSign;             // Direction the H-bridge was last set to, 0 after a stop
+    motor_profile_t profile;
+    motor_gains_t gains;
+};
+
+// Command for both wheels, posted by tasks and applied by the tick
+struct profileCommand {
+    uint32_t serial;            // Bumped by every command
+    uint32_t mode;              // COMMAND_SPEED, COMMAND_DISTANCE or COMMAND_HALT
+    int32_t speed[2];           // Target or cruise speed, cm/s Q16, signed
+    int64_t distance[2];        // Distance mode: cm Q16
+    int32_t scale[2];           // Share of the limits each wheel gets, Q16
+    int32_t maxAccel;           // cm/s^2 Q16
+    int32_t maxJerk;            // cm/s^3 Q16
+};
+
+static struct wheelControl wheels[2] = {
+    {.gains = {MOTOR_KP, MOTOR_KI, MOTOR_KD, MOTOR_FF_SLOPE, MOTOR_FF_OFFSET}},
+    {.gains = {MOTOR_KP, MOTOR_KI, MOTOR_KD, MOTOR_FF_SLOPE, MOTOR_FF_OFFSET}},
+};
+
+static struct profileCommand pendingCommand = {
+    .scale = {1 << 16, 1 << 16},
+    .maxAccel = (int32_t)(MOTOR_MAX_ACCEL * (1 << 16)),
+    .maxJerk = (int32_t)(MOTOR_MAX_JERK * (1 << 16)),
+};
+
+// Serial of the last command the tick applied
+static volatile uint32_t appliedSerial;
+
+static repeating_timer_t controlTimer;
+static int controlRunning;
+
+// Set by motor_emergency_stop(); targets are ignored until it is released
+static volatile int emergencyLatched;
+
+/**
+ * @brief Runs one PID step of a wheel.
+ *
+ * @param wheel Controller of the wheel.
+ * @param speed Measured speed, cm/s Q16.
+ * @return PWM level, 0 to PWM_WRAP.
+ */
+static uint16_t controlStep(struct wheelControl *wheel, int32_t speed) {
+    int32_t target = wheel->target;
+    const motor_gains_t *gains = &wheel->gains;
+    int32_t lastSpeed = wheel->lastSpeed;
+
+    wheel->lastSpeed = speed;
+
+    if (target == 0) {
+        wheel->integral = 0;
+        return 0;
+    }
+
+    int32_t error = target - speed;
+    int32_t feedforward = gains->ffOffset + (int32_t)(((int64_t)gains->ffSlope * target) >> 24);
+    int32_t proportional = (int32_t)(((int64_t)gains->kp * error) >> 24);
+    // Derivative on the measurement, so target changes do not kick it
+    int32_t derivative = -(int32_t)(((int64_t)gains->kd * (speed - lastSpeed) * MOTOR_CONTROL_HZ) >> 24);
+    int32_t integral = wheel->integral + (int32_t)(((int64_t)gains->ki * error / MOTOR_CONTROL_HZ) >> MOTOR_GAIN_FRACTION_BITS);
+
+    if (integral > (MOTOR_INTEGRAL_LIMIT << 16)) {
+        integral = MOTOR_INTEGRAL_LIMIT << 16;
+    }
+    else if (integral < -(MOTOR_INTEGRAL_LIMIT << 16)) {
+        integral = -(MOTOR_INTEGRAL_LIMIT << 16);
+    }
+
+    int32_t level = feedforward + proportional + derivative + (integral >> 16);
+
+    // Only integrate while the output can still act on the error
+    if (!((level > PWM_WRAP && error > 0) || (level < 0 && error < 0))) {
+        wheel->integral = integral;
+    }
+
+    if (level > PWM_WRAP) {
+        level = PWM_WRAP;
+    }
+    else if (level < 0) {
+        level = 0;
+    }
+
+    return (uint16_t)level;
+}
+
+/**
+ * @brief Scales a limit by a wheel's share, Q16.
+ */
+static inline int32_t scaleLimit(int32_t limit, int32_t scale) {
+    return (int32_t)(((int64_t)limit * scale) >> 16);
+}
+
+/**
+ * @brief Applies the pending command, if there is a new one.
+ *
+ * Runs in the tick, which posting masks out, so the command is never half written.
+ */
+static void applyCommand(void) {
+    const struct profileCommand *command = &pendingCommand;
+
+    if (command->serial == appliedSerial) {
+        return;
+    }
+
+    for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+        motor_profile_t *profile = &wheels[w].profile;
+        int32_t maxAccel = scaleLimit(command->maxAccel, command->scale[w]);
+        int32_t maxJerk = scaleLimit(command->maxJerk, command->scale[w]);
+
+        switch (command->mode) {
+        case COMMAND_HALT:
+            motor_profile_init(profile, maxAccel, maxJerk);
+            wheels[w].drivenSign = 0;
+            break;
+
+        case COMMAND_DISTANCE:
+            motor_profile_set_limits(profile, maxAccel, maxJerk);
+            motor_profile_set_distance(profile, command->distance[w], command->speed[w]);
+            break;
+
+        case COMMAND_SPEED:
+        default:
+            motor_profile_set_limits(profile, maxAccel, maxJerk);
+            motor_profile_set_speed(profile, command->speed[w]);
+            break;
+        }
+    }
+
+    appliedSerial = command->serial;
+}
+
+/**
+ * @brief Steps a wheel's profile and sets its H-bridge direction from the setpoint.
+ *
+ * The direction pins are only written when the setpoint changes sign, so an
+ * emergency stop() is not undone while the setpoint ramps down.
+ *
+ * @param w MOTOR_LEFT or MOTOR_RIGHT.
+ */
+static void stepProfile(int w) {
+    struct wheelControl *wheel = &wheels[w];
+    int32_t setpoint = motor_profile_step(&wheel->profile, MOTOR_CONTROL_HZ);
+    int sign = setpoint > 0 ? MOTOR_FORWARD : setpoint < 0 ? MOTOR_BACKWARD : 0;
+
+    if (sign != 0 && sign != wheel->drivenSign) {
+        if (w == MOTOR_LEFT) {
+            setLeftDirection(sign);
+        }
+        else {
+            setRightDirection(sign);
+        }
+    }
+
+    wheel->drivenSign = sign;
+    wheel->target = setpoint < 0 ? -setpoint : setpoint;
+}
+
+/**
+ * @brief Timer callback: one profile and control step for both wheels.
+ *
+ * @param timer The repeating timer (unused).
+ * @return true to keep the timer running.
+ */
+static bool controlTick(repeating_timer_t *timer) {
+    applyCommand();
+    stepProfile(MOTOR_LEFT);
+    stepProfile(MOTOR_RIGHT);
+
+    encoder_snapshot_t encoders;
+    encoder_get_snapshot(&encoders);
+
+    uint16_t left = controlStep(&wheels[MOTOR_LEFT], (int32_t)encoders.left.speed);
+    uint16_t right = controlStep(&wheels[MOTOR_RIGHT], (int32_t)encoders.right.speed);
+
+    motor_set_duty(left, right);
+    return true;
+}
+
+/**
+ * @brief Starts the controller tick with both wheels at rest.
+ *
+ * Call after initMotor() and initEncoder().
+ */
+void motor_speed_control_start(void) {
+    for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+        motor_profile_init(&wheels[w].profile, pendingCommand.maxAccel, pendingCommand.maxJerk);
+    }
+
+    motor_set_duty(0, 0);
+    // A negative period keeps ticks evenly spaced, however long a step takes
+    add_repeating_timer_us(-(1000000 / MOTOR_CONTROL_HZ), controlTick, NULL, &controlTimer);
+    controlRunning = 1;
+}
+
+/**
+ * @brief Stops the controller tick and both wheels.
+ *
+ * For code that drives the PWM levels itself for a while, such as
+ * motor_calibrate().
+ *
+ * @return 1 if the tick was running, otherwise 0.
+ */
+int motor_speed_control_stop(void) {
+    int wasRunning = controlRunning;
+
+    if (wasRunning) {
+        cancel_repeating_timer(&controlTimer);
+        controlRunning = 0;
+    }
+
+    motor_set_duty(0, 0);
+    return wasRunning;
+}
+
+/**
+ * @brief Converts cm/s to Q16.
+ */
+static inline int32_t speedFixed(float speed) {
+    return (int32_t)(speed * (1 << ENCODER_SPEED_FRACTION_BITS));
+}
+
+/**
+ * @brief Ramps both wheels to target speeds and holds them there.
+ *
+ * The setpoints follow the profile limits, so a change of direction slows down
+ * through zero before the H-bridge is reversed.
+ *
+ * @param left Left wheel speed in cm/s, negative for backwards.
+ * @param right Right wheel speed in cm/s, negative for backwards.
+ * @return 0, or -1 if an emergency stop is latched and the target was dropped.
+ */
+int motor_set_target_speed(float left, float right) {
+    uint32_t status = save_and_disable_interrupts();
+
+    if (emergencyLatched) {
+        restore_interrupts(status);
+        return -1;
+    }
+
+    pendingCommand.mode = COMMAND_SPEED;
+    pendingCommand.speed[MOTOR_LEFT] = speedFixed(left);
+    pendingCommand.speed[MOTOR_RIGHT] = speedFixed(right);
+    pendingCommand.scale[MOTOR_LEFT] = 1 << 16;
+    pendingCommand.scale[MOTOR_RIGHT] = 1 << 16;
+    pendingCommand.serial++;
+    restore_interrupts(status);
+
+    return 0;
+}
+
+/**
+ * @brief Drives each wheel a distance and stops.
+ *
+ * The wheel with further to go cruises at speed. The other one gets speed,
+ * acceleration and jerk scaled down in proportion, so both profiles keep the
+ * same shape and the wheels start and stop together.
+ *
+ * @param left Left wheel distance in mm, negative for backwards.
+ * @param right Right wheel distance in mm, negative for backwards.
+ * @param speed Cruise speed of the wheel with further to go, cm/s.
+ * @return 0, or -1 if an emergency stop is latched and the target was dropped.
+ */
+int motor_set_target_distance(int32_t left, int32_t right, float speed) {
+    int32_t distance[2] = {left < 0 ? -left : left, right < 0 ? -right : right};
+    int32_t longest = distance[MOTOR_LEFT] > distance[MOTOR_RIGHT] ? distance[MOTOR_LEFT] : distance[MOTOR_RIGHT];
+    int32_t cruise = speedFixed(speed < 0.0f ? -speed : speed);
+
+    uint32_t status = save_and_disable_interrupts();
+
+    if (emergencyLatched) {
+        restore_interrupts(status);
+        return -1;
+    }
+
+    pendingCommand.mode = COMMAND_DISTANCE;
+
+    for (int w = MOTOR_LEFT; w <= MOTOR_RIGHT; w++) {
+        int32_t scale = longest == 0 ? 1 << 16 : (int32_t)(((int64_t)distance[w] << 16) / longest);
+        int32_t wheelSpeed = scaleLimit(cruise, scale);
+
+        pendingCommand.scale[w] = scale;
+        pendingCommand.distance[w] = ((int64_t)distance[w] << 16) / 10;
+        pendingCommand.speed[w] = (w == MOTOR_LEFT ? left : right) < 0 ? -wheelSpeed : wheelSpeed;
+    }
+
+    pendingCommand.serial++;
+    restore_interrupts(status);
+
+    return 0;
+}
+
+/**
+ * @brief Stops both setpoints at once, without a ramp.
+ *
+ * For emergencies, with stop() to cut the H-bridge straight away; the next
+ * target sets the direction pins again.
+ */
+void motor_halt(void) {
+    uint32_t status = save_and_disable_interrupts();
+    pendingCommand.mode = COMMAND_HALT;
+    pendingCommand.scale[MOTOR_LEFT] = 1 << 16;
+    pendingCommand.scale[MOTOR_RIGHT] = 1 << 16;
+    pendingCommand.serial++;
+    restore_interrupts(status);
+}
+
+/**
+ * @brief Cuts both wheels now and ignores targets until released.
+ *
+ * Sets both PWM levels to zero and opens the H-bridge before returning, then
+ * leaves the tick a halt to apply, so it does not drive the wheels again.
+ * motor_set_target_speed() and motor_set_target_distance() return -1 until
+ * motor_emergency_release(). Safe to call from interrupt context.
+ */
+void motor_emergency_stop(void) {
+    uint32_t status = save_and_disable_interrupts();
+    motor_set_duty(0, 0);
+    stop(NULL);
+    emergencyLatched = 1;
+    pendingCommand.mode = COMMAND_HALT;
+    pendingCommand.scale[MOTOR_LEFT] = 1 << 16;
+    pendingCommand.scale[MOTOR_RIGHT] = 1 << 16;
+    pendingCommand.serial++;
+    restore_interrupts(status);
+}
+
+/**
+ * @brief Accepts targets again after motor_emergency_stop().
+ *
+ * The wheels stay stopped until the next target.
+ */
+void motor_emergency_release(void) {
+    emergencyLatched = 0;
+}
+
+/**
+ * @brief Checks whether motor_emergency_stop() is holding the wheels.
+ *
+ * @return 1 while stopped, otherwise 0.
+ */
+int motor_emergency_latched(void) {
+    return emergencyLatched;
+}
+
+/**
+ * @brief Changes the acceleration and jerk limits of the profiles.
+ *
+ * Commands posted from then on use them; one already running keeps its own.
+ *
+ * @param accel Acceleration limit in cm/s^2, above 0.
+ * @param jerk Jerk limit in cm/s^3, or 0 for trapezoidal ramps.
+ */
+void motor_set_profile_limits(float accel, float jerk) {
+    uint32_t status = save_and_disable_interrupts();
+    pendingCommand.maxAccel = (int32_t)(accel * (1 << 16));
+    pendingCommand.maxJerk = (int32_t)(jerk * (1 << 16));
+    restore_interrupts(status);
+}
+
+/**
+ * @brief Checks whether the last motor_set_target_distance() has finished.
+ *
+ * @return 1 once the tick took the command and both wheels covered their
+ *         distance and stopped, otherwise 0. Always 0 while holding a speed.
+ */
+int motor_target_reached(void) {
+    return appliedSerial == pendingCommand.serial &&
+           wheels[MOTOR_LEFT].profile.done && wheels[MOTOR_RIGHT].profile.done;
+}
+
+/**
+ * @brief Replaces the gains of one wheel's controller.
+ *
+ * The tick reads the gains without a lock, so call this before
+ * motor_speed_control_start() or while the wheel's target is zero.
+ *
+ * @param wheel MOTOR_LEFT or MOTOR_RIGHT.
+ * @param gains New gains.
+ */
+void motor_set_gains(int wheel, const motor_gains_t *gains) {
+    wheels[wheel].gains = *gains;
+}
+
+/**
+ * @brief Gets the gains of one wheel's controller.
+ *
+ * @param wheel MOTOR_LEFT or MOTOR_RIGHT.
+ * @param gains Filled with the gains.
+ */
+void motor_get_gains(int wheel, motor_gains_t *gains) {
+    *gains = wheels[wheel].gains;
+}
+
+/*** End of file ***/
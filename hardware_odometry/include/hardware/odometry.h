@@ -0,0 +1,59 @@
+/**
+ * @file odometry.h
+ *
+ * @brief Provides differential-drive odometry: a live pose of the car from the
+ *        wheel encoders.
+ *
+ * odometry_update() takes an encoder snapshot, turns the notches each wheel moved
+ * since the previous update into signed distances (the motor module tells which
+ * way each wheel was driven) and integrates them into a pose. Call it at a fixed
+ * rate, ODOMETRY_RATE_HZ by default; a higher rate follows curves more closely.
+ *
+ * The pose is fixed point: x and y in micrometres from where the car started
+ * (or was last reset), and the heading as a binary angle, where 2^32 is a full
+ * turn, so it wraps by itself. 0 points along +x and angles grow anticlockwise.
+ *
+ * The pose comes with its 3x3 covariance in mm and rad, grown by each wheel's
+ * travel. Readers get the pose and covariance together from odometry_get_pose(),
+ * which retries if an update lands while it copies instead of blocking the
+ * update.
+ *
+ */
+
+#ifndef _ODOMETRY_H
+#define _ODOMETRY_H
+
+#include <stdint.h>
+
+// Car geometry and noise model
+#define ODOMETRY_TRACK_UM 120000        // Distance between the wheel contact points in micrometres
+#define ODOMETRY_WHEEL_VARIANCE 1.0f    // Wheel distance variance in mm^2 per mm travelled
+
+// Update rate of the odometry task
+#ifndef ODOMETRY_RATE_HZ
+#define ODOMETRY_RATE_HZ 100
+#endif
+
+// Binary angles: 2^32 per full turn
+#define ODOMETRY_ANGLE_FROM_DEGREES(degrees) ((uint32_t)(int32_t)((degrees) * (4294967296.0 / 360)))
+#define ODOMETRY_ANGLE_TO_DEGREES(angle) ((uint32_t)(((uint64_t)(angle) * 360) >> 32))
+
+// Pose of the car and its uncertainty at one instant
+typedef struct {
+    int32_t x;                  // Micrometres
+    int32_t y;                  // Micrometres
+    uint32_t theta;             // Heading, binary angle
+    uint32_t time_us;           // Encoder snapshot the pose was integrated up to
+    float covariance[3][3];     // Over (x mm, y mm, theta rad)
+} odometry_pose_t;
+
+void odometry_init(void);
+void odometry_reset(int32_t x, int32_t y, uint32_t theta);
+void odometry_update(void);
+void odometry_get_pose(odometry_pose_t *pose);
+int32_t odometry_sin(uint32_t angle);
+int32_t odometry_cos(uint32_t angle);
+
+#endif
+
+/*** End of file ***/
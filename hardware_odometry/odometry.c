@@ -0,0 +1,253 @@
+/**
+ * @file odometry.c
+ *
+ * @brief Implements differential-drive odometry on top of the wheel encoders.
+ *
+ * Each update moves the pose along the arc the wheels drove since the previous
+ * one, using the heading halfway through the step. Sines come from a quarter-wave
+ * table with linear interpolation, so the pose never leaves integer maths. The
+ * covariance only needs a few significant digits and is propagated in float,
+ * about 40 operations per update in task context.
+ *
+ * The odometry task is the only writer. It publishes each pose under a sequence
+ * lock (seqlock.h), so readers in other tasks copy it and retry rather than take
+ * a lock.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hardware/sync.h"
+#include "hardware/seqlock.h"
+#include "hardware/encoder.h"
+#include "hardware/motor.h"
+#include "hardware/odometry.h"
+
+#define ODOMETRY_ANGLE_PER_RAD 683565276LL  // 2^32 / (2 pi)
+#define ODOMETRY_SIN_STEPS 64               // Table entries per quarter turn
+#define ODOMETRY_SIN_ONE 32768              // sin = 1 in Q15
+
+// sin(k * 90 / ODOMETRY_SIN_STEPS degrees) in Q15
+static const int16_t sinTable[ODOMETRY_SIN_STEPS + 1] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+    6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767,
+};
+
+// Pose being integrated, only touched by the odometry task
+static odometry_pose_t current;
+static uint32_t lastLeftCount;
+static uint32_t lastRightCount;
+
+// Pose published to readers, and its lock
+static odometry_pose_t published;
+static seqlock_t poseLock;
+
+// Pose requested by odometry_reset(), applied by the next update
+static volatile int resetPending;
+static int32_t resetX;
+static int32_t resetY;
+static uint32_t resetTheta;
+
+/**
+ * @brief Gets the sine of a binary angle.
+ *
+ * @param angle Angle, 2^32 per full turn.
+ * @return Sine in Q15.
+ */
+int32_t odometry_sin(uint32_t angle) {
+    uint32_t quadrant = angle >> 30;
+    uint32_t phase = angle & 0x3FFFFFFF;
+
+    if (quadrant & 1) {
+        phase = 0x40000000 - phase;
+    }
+
+    uint32_t index = phase >> 24;
+    int32_t value = sinTable[index];
+
+    if (index < ODOMETRY_SIN_STEPS) {
+        int32_t fraction = (phase >> 8) & 0xFFFF;
+        value += ((sinTable[index + 1] - value) * fraction) >> 16;
+    }
+
+    return (quadrant & 2) ? -value : value;
+}
+
+/**
+ * @brief Gets the cosine of a binary angle.
+ *
+ * @param angle Angle, 2^32 per full turn.
+ * @return Cosine in Q15.
+ */
+int32_t odometry_cos(uint32_t angle) {
+    return odometry_sin(angle + 0x40000000);
+}
+
+/**
+ * @brief Publishes the current pose to readers.
+ */
+static void publishPose(void) {
+    seqlock_write_begin(&poseLock);
+    memcpy(&published, &current, sizeof(published));
+    seqlock_write_end(&poseLock);
+}
+
+/**
+ * @brief Starts odometry at the origin, heading along +x, with no uncertainty.
+ *
+ * Call once, after the encoders are set up and before the odometry task runs.
+ */
+void odometry_init(void) {
+    encoder_snapshot_t encoders;
+    encoder_get_snapshot(&encoders);
+
+    memset(&current, 0, sizeof(current));
+    current.time_us = encoders.time_us;
+    lastLeftCount = encoders.left.count;
+    lastRightCount = encoders.right.count;
+    resetPending = 0;
+
+    publishPose();
+}
+
+/**
+ * @brief Moves the pose to a known position and heading and clears its uncertainty.
+ *
+ * Safe from any task; the odometry task applies it at its next update.
+ *
+ * @param x Position in micrometres.
+ * @param y Position in micrometres.
+ * @param theta Heading, binary angle.
+ */
+void odometry_reset(int32_t x, int32_t y, uint32_t theta) {
+    resetPending = 0;
+    __dmb();
+    resetX = x;
+    resetY = y;
+    resetTheta = theta;
+    __dmb();
+    resetPending = 1;
+}
+
+/**
+ * @brief Grows the covariance by one step of the motion model.
+ *
+ * The step moves the car by ds along the heading, whose sine and cosine are
+ * given, and turns it by the wheel difference over the track. The heading
+ * uncertainty leaks into x and y in proportion to ds, and each wheel adds
+ * ODOMETRY_WHEEL_VARIANCE per mm it drove.
+ *
+ * @param p Covariance over (x mm, y mm, theta rad), updated in place.
+ * @param left Left wheel travel in micrometres.
+ * @param right Right wheel travel in micrometres.
+ * @param sine Sine of the heading halfway through the step, Q15.
+ * @param cosine Cosine of the heading halfway through the step, Q15.
+ */
+static void propagateCovariance(float p[3][3], int32_t left, int32_t right, int32_t sine, int32_t cosine) {
+    float ds = (left + right) / 2000.0f;
+    float track = ODOMETRY_TRACK_UM / 1000.0f;
+    float s = (float)sine / ODOMETRY_SIN_ONE;
+    float c = (float)cosine / ODOMETRY_SIN_ONE;
+    float a = -ds * s;              // d(x)/d(theta)
+    float b = ds * c;               // d(y)/d(theta)
+
+    // Heading uncertainty carried into position
+    float p00 = p[0][0] + 2 * a * p[0][2] + a * a * p[2][2];
+    float p01 = p[0][1] + a * p[1][2] + b * p[0][2] + a * b * p[2][2];
+    float p02 = p[0][2] + a * p[2][2];
+    float p11 = p[1][1] + 2 * b * p[1][2] + b * b * p[2][2];
+    float p12 = p[1][2] + b * p[2][2];
+    float p22 = p[2][2];
+
+    // Wheel noise through the Jacobian of the step in each wheel's travel
+    float qLeft = ODOMETRY_WHEEL_VARIANCE * (left < 0 ? -left : left) / 1000.0f;
+    float qRight = ODOMETRY_WHEEL_VARIANCE * (right < 0 ? -right : right) / 1000.0f;
+    float xl = c / 2 + ds * s / (2 * track);
+    float xr = c / 2 - ds * s / (2 * track);
+    float yl = s / 2 - ds * c / (2 * track);
+    float yr = s / 2 + ds * c / (2 * track);
+    float tl = -1 / track;
+    float tr = 1 / track;
+
+    p00 += xl * xl * qLeft + xr * xr * qRight;
+    p01 += xl * yl * qLeft + xr * yr * qRight;
+    p02 += xl * tl * qLeft + xr * tr * qRight;
+    p11 += yl * yl * qLeft + yr * yr * qRight;
+    p12 += yl * tl * qLeft + yr * tr * qRight;
+    p22 += tl * tl * qLeft + tr * tr * qRight;
+
+    p[0][0] = p00;
+    p[0][1] = p[1][0] = p01;
+    p[0][2] = p[2][0] = p02;
+    p[1][1] = p11;
+    p[1][2] = p[2][1] = p12;
+    p[2][2] = p22;
+}
+
+/**
+ * @brief Integrates the wheel travel since the previous update into the pose.
+ *
+ * Call from the odometry task at ODOMETRY_RATE_HZ. Notches are signed by the
+ * direction the motor module last drove each wheel in.
+ */
+void odometry_update(void) {
+    encoder_snapshot_t encoders;
+    encoder_get_snapshot(&encoders);
+
+    if (resetPending) {
+        __dmb();
+        memset(&current, 0, sizeof(current));
+        current.x = resetX;
+        current.y = resetY;
+        current.theta = resetTheta;
+        resetPending = 0;
+    }
+
+    int32_t left = (int32_t)(encoders.left.count - lastLeftCount) * ENCODER_UM_PER_NOTCH * getLeftDirection(NULL);
+    int32_t right = (int32_t)(encoders.right.count - lastRightCount) * ENCODER_UM_PER_NOTCH * getRightDirection(NULL);
+    lastLeftCount = encoders.left.count;
+    lastRightCount = encoders.right.count;
+
+    if (left != 0 || right != 0) {
+        int32_t ds = (left + right) / 2;
+        int32_t turn = (int32_t)((int64_t)(right - left) * ODOMETRY_ANGLE_PER_RAD / ODOMETRY_TRACK_UM);
+        uint32_t midway = current.theta + (uint32_t)(turn / 2);
+        int32_t sine = odometry_sin(midway);
+        int32_t cosine = odometry_cos(midway);
+
+        current.x += (int32_t)(((int64_t)ds * cosine + ODOMETRY_SIN_ONE / 2) >> 15);
+        current.y += (int32_t)(((int64_t)ds * sine + ODOMETRY_SIN_ONE / 2) >> 15);
+        current.theta += (uint32_t)turn;
+        propagateCovariance(current.covariance, left, right, sine, cosine);
+    }
+
+    current.time_us = encoders.time_us;
+    publishPose();
+}
+
+/**
+ * @brief Gets the latest pose and its covariance, consistent with each other.
+ *
+ * Never blocks the odometry task: if it publishes while the copy is taken, the
+ * copy is taken again.
+ *
+ * @param pose Filled with the pose.
+ */
+void odometry_get_pose(odometry_pose_t *pose) {
+    uint32_t sequence;
+
+    do {
+        sequence = seqlock_read_begin(&poseLock);
+        memcpy(pose, &published, sizeof(*pose));
+    } while (seqlock_read_retry(&poseLock, sequence));
+}
+
+/*** End of file ***/
@@ -0,0 +1,63 @@
+/**
+ * @file safety.h
+ *
+ * @brief Provides the safety monitor: an emergency stop driven by the range filter.
+ *
+ * The ultrasonic task hands every new range filter output to
+ * safety_report_range(). When the output says stop, it notifies the stop
+ * handler, safety_task(), which runs above every other application task and
+ * calls motor_emergency_stop(). So the wheels stop within one context switch
+ * of the reading, whatever the driving logic is doing, even inside a turn.
+ * The handler then cancels any queued motion.
+ *
+ * The stop is latched until SAFETY_CLEAR_READINGS outputs in a row are clear:
+ * either nothing is in range, or the range leaves room to brake again from
+ * SAFETY_RESUME_SPEED_MM_S with SAFETY_RELEASE_MARGIN_MM to spare. A car
+ * stopped short of an obstacle stays stopped rather than creeping up to it one
+ * stop at a time.
+ * If no output arrives for SAFETY_STALE_MS the handler stops the car too, as
+ * the sensor or its task has failed.
+ *
+ * Each stop records two latencies: from the report of the reading to the PWM
+ * being cut (the stop path), and from the echo ending to the PWM being cut
+ * (filter included). safety_get_stats() returns the last and worst of both.
+ *
+ */
+
+#ifndef _SAFETY_H
+#define _SAFETY_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "hardware/range_filter.h"
+
+// Constants for the safety monitor
+#define SAFETY_TASK_PRIORITY (configMAX_PRIORITIES - 2)    // Just below the timer task
+#define SAFETY_STALE_MS 200             // No range output for this long stops the car
+#define SAFETY_CLEAR_READINGS 5         // Clear outputs in a row that release a stop
+#ifndef SAFETY_RESUME_SPEED_MM_S
+#define SAFETY_RESUME_SPEED_MM_S 250    // Speed the car drives off at once released (DRIVE_SPEED)
+#endif
+#define SAFETY_RELEASE_MARGIN_MM 100    // Room beyond the stop range needed to release a stop
+
+// Stops and their latencies
+typedef struct {
+    uint32_t stops;             // Stops for an obstacle
+    uint32_t staleStops;        // Stops for missing range outputs
+    uint32_t lastLatencyUs;     // Report to PWM cut of the last obstacle stop
+    uint32_t maxLatencyUs;      // Worst report to PWM cut
+    uint32_t lastEchoLatencyUs; // Echo end to PWM cut of the last obstacle stop
+    uint32_t maxEchoLatencyUs;  // Worst echo end to PWM cut
+} safety_stats_t;
+
+void safety_task(void *params);
+void safety_report_range(const range_output_t *range);
+int safety_is_stopped(void);
+void safety_get_stats(safety_stats_t *stats);
+
+#endif
+#define SAFETY_RELEASE_MARGIN_MM 100    // Room beyond the stop range needed to release a stop
+
+/*** End of file ***/
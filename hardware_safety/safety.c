@@ -0,0 +1,171 @@
+/**
+ * @file safety.c
+ *
+ * @brief Implements the safety monitor's stop handler and its latch.
+ *
+ * safety_report_range() runs in the ultrasonic task and only decides; the
+ * handler task does the stopping. With the handler above every other
+ * application task, the notification switches to it at once, so the stop path
+ * is bounded by one context switch plus motor_emergency_stop(). The stale
+ * check runs on the handler's notification timeout, so it needs no timer of
+ * its own.
+ *
+ */
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "hardware/speed_control.h"
+#include "hardware/motion.h"
+#include "hardware/safety.h"
+
+// Stop handler task, set once it runs
+static TaskHandle_t stopHandler = NULL;
+
+// When the last range output was reported, 32-bit microseconds since boot
+static volatile uint32_t lastReportUs = 0;
+
+// Stop asked for by safety_report_range() and not yet handled, with its times
+static volatile int stopRequested = 0;
+static volatile uint32_t requestUs = 0;
+static volatile uint32_t echoUs = 0;
+
+// Latched from a stop until SAFETY_CLEAR_READINGS clear outputs in a row
+static volatile int stopped = 0;
+static int clearReadings = 0;
+
+static safety_stats_t stats;
+
+/**
+ * @brief Hands a new range filter output to the monitor.
+ *
+ * Call from the task that updates the filter, once per output. Wakes the stop
+ * handler when the output says stop. An output that is not a stop is only clear
+ * if nothing is in range, or if the car could drive off at
+ * SAFETY_RESUME_SPEED_MM_S and still stop in time, with SAFETY_RELEASE_MARGIN_MM
+ * to spare so it does not stop again straight away. Once stopped, the closing
+ * speed is about 0, so the stop flag alone would release the car as soon as it
+ * stood more than the minimum gap away. A stop is released once enough outputs
+ * in a row are clear.
+ *
+ * @param range Output just published by range_filter_update().
+ */
+void safety_report_range(const range_output_t *range) {
+    lastReportUs = time_us_32();
+
+    if (range->stop) {
+        clearReadings = 0;
+
+        if (!stopped && !stopRequested) {
+            requestUs = time_us_32();
+            echoUs = range->time_us;
+            stopRequested = 1;
+
+            if (stopHandler != NULL) {
+                xTaskNotifyGive(stopHandler);
+            }
+            else {
+                // No handler yet: stop from here rather than not at all
+                motor_emergency_stop();
+            }
+        }
+        return;
+    }
+
+    int32_t closing = SAFETY_RESUME_SPEED_MM_S + (range->closing_mm_s > 0 ? range->closing_mm_s : 0);
+    int clear = !range->tracking ||
+                range->range_mm > RANGE_FILTER_MIN_GAP_MM + range_filter_braking_mm(closing) + SAFETY_RELEASE_MARGIN_MM;
+
+    if (!clear) {
+        clearReadings = 0;
+        return;
+    }
+
+    if (stopped && ++clearReadings >= SAFETY_CLEAR_READINGS) {
+        // Release the motors first, so a task that sees stopped clear can drive
+        clearReadings = 0;
+        motor_emergency_release();
+        stopped = 0;
+    }
+}
+
+/**
+ * @brief Stops the wheels, cancels queued motion and latches the stop.
+ *
+ * @return When the PWM was cut, 32-bit microseconds since boot.
+ */
+static uint32_t emergencyStop(void) {
+    motor_emergency_stop();
+    uint32_t off = time_us_32();
+
+    stopped = 1;
+    clearReadings = 0;
+    motion_cancel();
+
+    return off;
+}
+
+/**
+ * @brief Stop handler task. Create with SAFETY_TASK_PRIORITY.
+ *
+ * @param params Task parameters (unused).
+ */
+void safety_task(void *params) {
+    lastReportUs = time_us_32();
+    stopHandler = xTaskGetCurrentTaskHandle();
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SAFETY_STALE_MS / 2));
+
+        if (stopRequested) {
+            uint32_t off = emergencyStop();
+            uint32_t latency = off - requestUs;
+            uint32_t echoLatency = off - echoUs;
+            stopRequested = 0;
+
+            taskENTER_CRITICAL();
+            stats.stops++;
+            stats.lastLatencyUs = latency;
+            stats.lastEchoLatencyUs = echoLatency;
+
+            if (latency > stats.maxLatencyUs) {
+                stats.maxLatencyUs = latency;
+            }
+            if (echoLatency > stats.maxEchoLatencyUs) {
+                stats.maxEchoLatencyUs = echoLatency;
+            }
+            taskEXIT_CRITICAL();
+        }
+        else if (!stopped && time_us_32() - lastReportUs > SAFETY_STALE_MS * 1000u) {
+            emergencyStop();
+
+            taskENTER_CRITICAL();
+            stats.staleStops++;
+            taskEXIT_CRITICAL();
+        }
+    }
+}
+
+/**
+ * @brief Checks whether the monitor is holding the car stopped.
+ *
+ * @return 1 while stopped, otherwise 0.
+ */
+int safety_is_stopped(void) {
+    return stopped || stopRequested;
+}
+
+/**
+ * @brief Gets the stop counts and latencies.
+ *
+ * @param out Filled with a consistent copy.
+ */
+void safety_get_stats(safety_stats_t *out) {
+    taskENTER_CRITICAL();
+    *out = stats;
+    taskEXIT_CRITICAL();
+}
+
+/*** End of file ***/
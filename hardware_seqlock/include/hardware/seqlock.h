@@ -0,0 +1,45 @@
+/**
+ * @file seqlock.h
+ *
+ * @brief Provides a sequence lock for publishing a value from one writer.
+ *
+ * The writer bumps the sequence number to odd, copies the new value in and
+ * bumps it back to even. A reader notes the sequence number, copies the value
+ * out and takes the copy again if the number was odd or has moved since. The
+ * writer never waits and readers never block each other.
+ *
+ * There must be one writer at a time, and a reader must never interrupt it (a
+ * reader in an ISR that preempted the writer would retry forever), so readers
+ * and the writer are tasks. Both sides use full memory barriers.
+ *
+ * Typical use:
+ *
+ *     seqlock_write_begin(&lock);
+ *     published = value;
+ *     seqlock_write_end(&lock);
+ *
+ *     do {
+ *         sequence = seqlock_read_begin(&lock);
+ *         copy = published;
+ *     } while (seqlock_read_retry(&lock, sequence));
+ *
+ */
+
+#ifndef _SEQLOCK_H
+#define _SEQLOCK_H
+
+#include <stdint.h>
+
+// Lock state; zero is a valid, unlocked start
+typedef struct {
+    volatile uint32_t sequence;     // Odd while the writer is copying
+} seqlock_t;
+
+void seqlock_write_begin(seqlock_t *lock);
+void seqlock_write_end(seqlock_t *lock);
+uint32_t seqlock_read_begin(const seqlock_t *lock);
+int seqlock_read_retry(const seqlock_t *lock, uint32_t sequence);
+
+#endif
+
+/*** End of file ***/
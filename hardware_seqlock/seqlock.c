@@ -0,0 +1,61 @@
+/**
+ * @file seqlock.c
+ *
+ * @brief Implements the sequence lock.
+ *
+ * See seqlock.h for the protocol. The barriers keep the copy of the value
+ * between the two reads or writes of the sequence number, for the compiler
+ * as well as the CPU.
+ *
+ */
+
+#include <stdint.h>
+
+#include "hardware/sync.h"
+#include "hardware/seqlock.h"
+
+/**
+ * @brief Marks the published value as being written.
+ *
+ * @param lock Lock of the value.
+ */
+void seqlock_write_begin(seqlock_t *lock) {
+    lock->sequence++;
+    __dmb();
+}
+
+/**
+ * @brief Marks the published value as written.
+ *
+ * @param lock Lock of the value.
+ */
+void seqlock_write_end(seqlock_t *lock) {
+    __dmb();
+    lock->sequence++;
+}
+
+/**
+ * @brief Starts taking a copy of the published value.
+ *
+ * @param lock Lock of the value.
+ * @return Sequence number to pass to seqlock_read_retry().
+ */
+uint32_t seqlock_read_begin(const seqlock_t *lock) {
+    uint32_t sequence = lock->sequence;
+    __dmb();
+    return sequence;
+}
+
+/**
+ * @brief Checks whether a copy has to be taken again.
+ *
+ * @param lock Lock of the value.
+ * @param sequence Sequence number from seqlock_read_begin().
+ * @return 1 if the writer was busy during the copy, 0 if the copy is whole.
+ */
+int seqlock_read_retry(const seqlock_t *lock, uint32_t sequence) {
+    __dmb();
+    return (sequence & 1) || sequence != lock->sequence;
+}
+
+/*** End of file ***/
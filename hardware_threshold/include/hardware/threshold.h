@@ -0,0 +1,56 @@
+/**
+ * @file threshold.h
+ *
+ * @brief Provides an adaptive black/white threshold estimator for IR ADC streams.
+ *
+ * Each ADC channel gets its own threshold_t. Every reading pulls a running minimum
+ * (white level) and maximum (black level) towards it: a new extreme is taken at
+ * once, otherwise the extreme decays towards the reading by 1/2^decayShift per
+ * update. The colour switches with hysteresis around the midpoint of the two
+ * levels, so noise near the midpoint does not flicker between colours.
+ *
+ * While the surface under a sensor stays one colour the levels converge. Once the
+ * contrast drops below THRESHOLD_MIN_CONTRAST the switching points are frozen at
+ * their last good values until both colours have been seen again.
+ *
+ * Levels are kept in Q8 fixed point and updated with shifts and adds only, so the
+ * estimator can run at sample rate in interrupt context. The module only depends
+ * on the C standard headers.
+ *
+ */
+
+#ifndef _THRESHOLD_H
+#define _THRESHOLD_H
+
+#include <stdint.h>
+
+// Constants for the threshold estimator
+#define THRESHOLD_FRACTION_BITS 8       // Levels are kept in Q8 fixed point
+#define THRESHOLD_MIN_CONTRAST 200      // ADC counts between white and black needed to adapt
+#define THRESHOLD_HYSTERESIS_SHIFT 3    // Switching points sit contrast/8 either side of the midpoint
+
+// Estimator state for one ADC channel
+typedef struct {
+    uint32_t minQ8;         // Running white level
+    uint32_t maxQ8;         // Running black level
+    uint16_t low;           // Black to white below this reading
+    uint16_t high;          // White to black above this reading
+    uint8_t decayShift;     // Levels decay by 1/2^decayShift of the gap per update
+    uint8_t colour;         // 0 - white, 1 - black
+} threshold_t;
+
+// Live values of an estimator, in ADC counts
+typedef struct {
+    uint16_t white;
+    uint16_t black;
+    uint16_t low;
+    uint16_t high;
+} threshold_levels_t;
+
+void threshold_init(threshold_t *threshold, uint16_t white, uint16_t black, uint8_t decayShift);
+int threshold_update(threshold_t *threshold, uint16_t sample);
+void threshold_get_levels(const threshold_t *threshold, threshold_levels_t *levels);
+
+#endif
+
+/*** End of file ***/
@@ -0,0 +1,107 @@
+/**
+ * @file threshold.c
+ *
+ * @brief Implements the adaptive black/white threshold estimator.
+ *
+ * See threshold.h for the algorithm. All arithmetic is unsigned integer; the
+ * decay of a level is the gap to the reading shifted right, so a level never
+ * overshoots the reading.
+ *
+ */
+
+#include <stdint.h>
+
+#include "hardware/threshold.h"
+
+// Function to place the switching points around the midpoint of the two levels
+static void updateSwitchingPoints(threshold_t *threshold) {
+    uint32_t white = threshold->minQ8 >> THRESHOLD_FRACTION_BITS;
+    uint32_t black = threshold->maxQ8 >> THRESHOLD_FRACTION_BITS;
+
+    if (black < white + THRESHOLD_MIN_CONTRAST) {
+        // Only one colour seen lately; keep the last good switching points
+        return;
+    }
+
+    uint32_t middle = (white + black) / 2;
+    uint32_t band = (black - white) >> THRESHOLD_HYSTERESIS_SHIFT;
+
+    threshold->low = middle - band;
+    threshold->high = middle + band;
+}
+
+/**
+ * @brief Initializes an estimator with starting white and black levels.
+ *
+ * @param threshold Estimator to initialize.
+ * @param white Expected reading over white, used until the surface is seen.
+ * @param black Expected reading over black, used until the surface is seen.
+ * @param decayShift Levels forget 1/2^decayShift of their distance to each reading,
+ *                   so the time constant is 2^decayShift updates.
+ */
+void threshold_init(threshold_t *threshold, uint16_t white, uint16_t black, uint8_t decayShift) {
+    threshold->minQ8 = (uint32_t)white << THRESHOLD_FRACTION_BITS;
+    threshold->maxQ8 = (uint32_t)black << THRESHOLD_FRACTION_BITS;
+    threshold->decayShift = decayShift;
+    threshold->colour = 0;
+
+    // Start from the midpoint even if the starting levels are close together
+    threshold->low = (white + black) / 2;
+    threshold->high = threshold->low;
+    updateSwitchingPoints(threshold);
+}
+
+/**
+ * @brief Feeds one reading to an estimator and classifies it.
+ *
+ * @param threshold Estimator of the channel the reading came from.
+ * @param sample ADC reading (higher = darker).
+ * @return 1 if the sensor is over black, 0 if over white.
+ */
+int threshold_update(threshold_t *threshold, uint16_t sample) {
+    uint32_t sampleQ8 = (uint32_t)sample << THRESHOLD_FRACTION_BITS;
+
+    if (sampleQ8 <= threshold->minQ8) {
+        threshold->minQ8 = sampleQ8;
+    }
+    else {
+        threshold->minQ8 += (sampleQ8 - threshold->minQ8) >> threshold->decayShift;
+    }
+
+    if (sampleQ8 >= threshold->maxQ8) {
+        threshold->maxQ8 = sampleQ8;
+    }
+    else {
+        threshold->maxQ8 -= (threshold->maxQ8 - sampleQ8) >> threshold->decayShift;
+    }
+
+    updateSwitchingPoints(threshold);
+
+    if (threshold->colour == 0 && sample > threshold->high) {
+        threshold->colour = 1;
+    }
+    else if (threshold->colour == 1 && sample < threshold->low) {
+        threshold->colour = 0;
+    }
+
+    return threshold->colour;
+}
+
+/**
+ * @brief Reads the live levels of an estimator.
+ *
+ * Safe to call from another task while the estimator is being updated; each
+ * value is read with a single load, though the four may come from different
+ * updates.
+ *
+ * @param threshold Estimator to read.
+ * @param levels Filled with the white and black levels and switching points.
+ */
+void threshold_get_levels(const threshold_t *threshold, threshold_levels_t *levels) {
+    levels->white = threshold->minQ8 >> THRESHOLD_FRACTION_BITS;
+    levels->black = threshold->maxQ8 >> THRESHOLD_FRACTION_BITS;
+    levels->low = threshold->low;
+    levels->high = threshold->high;
+}
+
+/*** End of file ***/
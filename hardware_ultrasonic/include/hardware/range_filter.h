@@ -0,0 +1,79 @@
+/**
+ * @file range_filter.h
+ *
+ * @brief Provides the filter that turns raw ultrasonic readings into a tracked range.
+ *
+ * Each reading goes through a median of the last RANGE_FILTER_WINDOW echoes, so
+ * a single spurious echo cannot move the range, and then an alpha-beta tracker.
+ * The tracker predicts the range from the car's own speed (from the encoders)
+ * and the obstacle's speed, which it estimates from the residuals. That gives
+ * a closing speed that is right from the first reading of a still obstacle.
+ *
+ * Missed echoes are counted. After RANGE_FILTER_MAX_MISSES in a row the track
+ * is dropped and the road reads clear. The stop decision compares the range
+ * with the distance needed to stop from the closing speed, plus a minimum gap,
+ * so the car can drive faster without stopping early.
+ *
+ * One task updates the filter and others read its output, which is published
+ * under a sequence lock (seqlock.h).
+ *
+ */
+
+#ifndef _RANGE_FILTER_H
+#define _RANGE_FILTER_H
+
+#include <stdint.h>
+
+#include "hardware/seqlock.h"
+#include "hardware/ultrasonic.h"
+
+// Constants for the filter
+#define RANGE_FILTER_WINDOW 5               // Echoes in the median
+#define RANGE_FILTER_CONFIRM 3              // Echoes needed before a track starts
+#define RANGE_FILTER_MAX_MISSES 5           // Missed echoes in a row that drop the track
+#define RANGE_FILTER_GATE_MM 300            // Residual beyond which a median is an outlier
+#define RANGE_FILTER_MAX_OUTLIERS 3         // Outliers in a row that restart the track there
+#define RANGE_FILTER_ALPHA 0.5f
+#define RANGE_FILTER_BETA 0.1f
+
+// Constants for the stop decision
+#define RANGE_FILTER_MIN_GAP_MM 100         // Range to keep to the obstacle once stopped
+#define RANGE_FILTER_DECEL_MM_S2 1000       // Deceleration of an emergency stop
+#define RANGE_FILTER_LATENCY_MS 60          // Ping period plus reaction time
+#define RANGE_FILTER_NO_COLLISION UINT32_MAX
+
+// Filter output
+typedef struct {
+    uint32_t sequence;      // Ping number of the reading it was last updated with
+    uint32_t time_us;       // When that reading's echo ended, 32-bit microseconds since boot
+    int32_t range_mm;       // Filtered distance to the obstacle, if tracking
+    int32_t closing_mm_s;   // Speed the gap closes at, negative when opening
+    uint32_t ttc_ms;        // Time to collision, RANGE_FILTER_NO_COLLISION if not closing
+    int32_t braking_mm;     // Distance needed to stop from the closing speed
+    uint8_t tracking;       // 0 when nothing is in range
+    uint8_t stop;           // 1 when the car must stop now
+} range_output_t;
+
+// Filter state
+typedef struct {
+    int32_t window[RANGE_FILTER_WINDOW];    // Last echoes, mm
+    uint8_t count;
+    uint8_t next;
+    uint8_t misses;
+    uint8_t outliers;
+    uint8_t tracking;
+    float range;            // mm
+    float obstacleSpeed;    // mm/s, positive moving away
+    uint32_t lastTimeUs;
+    range_output_t published;
+    seqlock_t publishLock;
+} range_filter_t;
+
+void range_filter_init(range_filter_t *filter);
+void range_filter_update(range_filter_t *filter, const ultrasonic_event_t *reading, int32_t ownSpeed);
+void range_filter_get_output(range_filter_t *filter, range_output_t *output);
+int32_t range_filter_braking_mm(int32_t closing);
+
+#endif
+
+/*** End of file ***/
@@ -6,42 +6,92 @@
  * This module contains the definitions and function declarations necessary for
  * initializing and using an ultrasonic sensor. Functions include sensor initialization,
  * triggering pulse, distance measurement, and GPIO interrupt handling.
+ *
+ * The echo interrupt only timestamps the echo's edges. ultrasonic_process()
+ * turns each echo into a distance in task context and posts it as an event.
+ * ultrasonic_start() triggers pings from a hardware timer at a set rate; every
+ * reading carries its ping's sequence number.
+ * Each consumer calls ultrasonic_subscribe() once and then blocks on or polls
+ * its own bounded queue with ultrasonic_get_event().
+ *
+ * Several sensors are described by an array of ultrasonic_sensor_t given to
+ * ultrasonic_init_sensors(); initUltrasonic() sets up the single front sensor.
+ * Sensors in the same group fire together, so give a group only sensors that
+ * point well apart (left and right, say). The engine fires one group per slot,
+ * in turn. A group fires only once every echo of the group before has ended,
+ * and ULTRASONIC_TIMEOUT plus blanking has passed since it fired, so echoes
+ * from any range the sensors can measure have died out. Each sensor's newest
+ * reading is kept in a range table that ultrasonic_get_range_table() copies
+ * out in one piece.
  */
 #ifndef _ULTRASONIC_H
 #define _ULTRASONIC_H
 
-#include "hardware/ultrasonic.h"
+#include <stdint.h>
 #include "hardware/gpio.h"
 
 // Definitions for ultrasonic sensor pins and timeout value.
 #define ULTRASONIC_ECHO 10
 #define ULTRASONIC_TRIG 11
-#define ULTRASONIC_TIMEOUT 26100
+#define ULTRASONIC_LEFT_ECHO 7
+#define ULTRASONIC_LEFT_TRIG 6
+#define ULTRASONIC_RIGHT_ECHO 9
+#define ULTRASONIC_RIGHT_TRIG 8
+#define ULTRASONIC_TIMEOUT 26100        // Longest echo in range, in microseconds (about 4.5 m)
+#define ULTRASONIC_US_PER_CM 29         // Time sound takes to travel 1 cm
+#define ULTRASONIC_TRIGGER_US 10        // Trigger pulse the sensor needs
+
+// Ranging engine: slots per second (each fires one group of sensors), and the
+// quiet time after each echo before the next trigger, so reverberation from
+// the last ping dies out
+#define ULTRASONIC_RATE_HZ 50
+#define ULTRASONIC_BLANKING_US 2000
+
+// Set to 1 when side-facing sensors are fitted on the LEFT and RIGHT pins
+#ifndef ULTRASONIC_SIDE_SENSORS
+#define ULTRASONIC_SIDE_SENSORS 0
+#endif
+
+#define ULTRASONIC_MAX_SENSORS 4        // Sensors the engine can schedule
+
+#define ULTRASONIC_MAX_SUBSCRIBERS 4    // Consumers of ultrasonic readings
+#define ULTRASONIC_EVENT_QUEUE_DEPTH 4  // Readings buffered per consumer
+
+// One sensor
+typedef struct {
+    uint8_t trigPin;
+    uint8_t echoPin;
+    uint8_t group;          // Sensors with the same group fire together, groups in turn from 0
+    int16_t bearing;        // Direction it faces, degrees from the front, positive to the left
+} ultrasonic_sensor_t;
+
+// One reading, posted for every pulse
+typedef struct {
+    uint8_t sensor;         // Index of the sensor in the array given to ultrasonic_init_sensors()
+    uint32_t sequence;      // Ping number of the sensor, one higher for every trigger
+    uint32_t distance_mm;   // Distance to the obstacle, if valid
+    uint32_t echo_us;       // Echo width, if valid
+    uint32_t time_us;       // When the echo ended (or the wait gave up), 32-bit microseconds since boot
+    uint8_t valid;          // 0 if there was no echo in range
+} ultrasonic_event_t;
 
 /**
- * Initializes the ultrasonic sensor.
+ * Initializes the front ultrasonic sensor as the only one.
  *
  * @param params Optional parameters (unused in this function).
  */
 void initUltrasonic(void *params);
 
 /**
- * Triggers a pulse from the ultrasonic sensor.
+ * Triggers a pulse from the first sensor's group.
  *
  * @param params Optional parameters (unused in this function).
  */
 void pulseUltrasonic(void *params);
 
 /**
- * Measures the distance using the ultrasonic sensor.
- *
- * @param params Optional parameters (unused in this function).
- * @return Measured distance as a 64-bit unsigned integer.
- */
-uint64_t getDistanceUltrasonic(void *params);
-
-/**
- * Handles GPIO callbacks for the ultrasonic sensor.
+ * Handles GPIO callbacks for the ultrasonic sensors, on both echo edges.
+ * Ignores pins that are not a sensor's echo.
  *
  * @param gpio GPIO number associated with the callback.
  * @param events GPIO event that triggered the callback.
@@ -49,13 +99,26 @@ uint64_t getDistanceUltrasonic(void *params);
 void gpio_callback_ultrasonic(uint gpio, uint32_t events);
 
 /**
- * Retrieves the last measured distance from the ultrasonic sensor.
+ * Retrieves the last measured distance from the first sensor.
  *
  * @param params Optional parameters (unused in this function).
  * @return The last measured distance.
  */
 uint getUltrasonicFinalResult(void *params);
 
+void ultrasonic_init_sensors(const ultrasonic_sensor_t *sensors, int count);
+int ultrasonic_get_sensor_count(void);
+void ultrasonic_start(uint32_t rateHz, uint32_t blanking);
+void ultrasonic_stop(void);
+int ultrasonic_process(uint32_t timeout);
+void ultrasonic_get_reading(int sensor, ultrasonic_event_t *reading);
+int ultrasonic_get_range_table(ultrasonic_event_t table[ULTRASONIC_MAX_SENSORS]);
+uint32_t ultrasonic_get_skipped_slots(void);
+int ultrasonic_subscribe(void);
+int ultrasonic_get_event(int subscriber, ultrasonic_event_t *event, uint32_t timeout);
+uint32_t ultrasonic_get_dropped_events(int subscriber);
+uint32_t ultrasonic_get_isr_max_us(void);
+
 #endif /* _ULTRASONIC_H */
 
 /*** End of file ***/
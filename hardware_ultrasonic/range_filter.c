@@ -0,0 +1,202 @@
+/**
+ * @file range_filter.c
+ *
+ * @brief Implements the ultrasonic range filter: median, alpha-beta tracker and stop decision.
+ *
+ * The tracker state is the range and the obstacle's own speed. Between
+ * readings the range changes by (obstacle speed - car speed) * dt. Each
+ * median then corrects the range by ALPHA of the residual and the obstacle
+ * speed by BETA of the residual over dt. Echoes in the median window are
+ * shifted by the car's own travel as it goes, so the median is of where the
+ * obstacle is now rather than a few pings ago. Runs in task context once per ping,
+ * so float is fine.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/seqlock.h"
+#include "hardware/range_filter.h"
+
+/**
+ * @brief Starts a filter with nothing in range.
+ *
+ * @param filter Filter to set up.
+ */
+void range_filter_init(range_filter_t *filter) {
+    memset(filter, 0, sizeof(*filter));
+    filter->published.ttc_ms = RANGE_FILTER_NO_COLLISION;
+}
+
+/**
+ * @brief Gets the median of the echoes in the window.
+ *
+ * @param filter Filter with at least one echo.
+ * @return Median in mm.
+ */
+static int32_t windowMedian(const range_filter_t *filter) {
+    int32_t sorted[RANGE_FILTER_WINDOW];
+    int count = filter->count;
+
+    for (int i = 0; i < count; i++) {
+        int32_t value = filter->window[i];
+        int j = i;
+
+        while (j > 0 && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+
+    return sorted[count / 2];
+}
+
+/**
+ * @brief Publishes the output of one reading to readers.
+ */
+static void publishOutput(range_filter_t *filter, const range_output_t *output) {
+    seqlock_write_begin(&filter->publishLock);
+    filter->published = *output;
+    seqlock_write_end(&filter->publishLock);
+}
+
+/**
+ * @brief Gets the distance needed to stop from a closing speed.
+ *
+ * Covers the ping period and reaction time at that speed, then an emergency
+ * stop at RANGE_FILTER_DECEL_MM_S2.
+ *
+ * @param closing Closing speed, mm/s.
+ * @return Braking distance in mm, 0 if not closing.
+ */
+int32_t range_filter_braking_mm(int32_t closing) {
+    if (closing <= 0) {
+        return 0;
+    }
+
+    return (int32_t)(closing * RANGE_FILTER_LATENCY_MS / 1000.0f +
+                     (float)closing * closing / (2.0f * RANGE_FILTER_DECEL_MM_S2));
+}
+
+/**
+ * @brief Feeds one reading into the filter and publishes the new output.
+ *
+ * @param filter Filter to update.
+ * @param reading Reading from ultrasonic_process(), valid or not.
+ * @param ownSpeed Car's speed towards the sensor's side, mm/s (encoders).
+ */
+void range_filter_update(range_filter_t *filter, const ultrasonic_event_t *reading, int32_t ownSpeed) {
+    float dt = (reading->time_us - filter->lastTimeUs) / 1e6f;
+    filter->lastTimeUs = reading->time_us;
+
+    if (dt <= 0.0f || dt > 1.0f) {
+        dt = 0.0f;
+    }
+
+    // Predict from both speeds whether or not there is an echo
+    if (filter->tracking) {
+        filter->range += (filter->obstacleSpeed - ownSpeed) * dt;
+    }
+
+    // Move the older echoes by the car's own travel, so the median does not lag
+    // behind while the car drives up to a still obstacle
+    int32_t travel = (int32_t)(ownSpeed * dt + (ownSpeed < 0 ? -0.5f : 0.5f));
+
+    for (int i = 0; i < filter->count; i++) {
+        filter->window[i] -= travel;
+    }
+
+    if (!reading->valid) {
+        if (++filter->misses >= RANGE_FILTER_MAX_MISSES) {
+            // Nothing in range for a while: forget the track and the echoes
+            filter->tracking = 0;
+            filter->count = 0;
+            filter->next = 0;
+        }
+    }
+    else {
+        filter->misses = 0;
+        filter->window[filter->next] = (int32_t)reading->distance_mm;
+        filter->next = (filter->next + 1) % RANGE_FILTER_WINDOW;
+
+        if (filter->count < RANGE_FILTER_WINDOW) {
+            filter->count++;
+        }
+
+        float median = (float)windowMedian(filter);
+        float residual = median - filter->range;
+
+        if (!filter->tracking) {
+            if (filter->count >= RANGE_FILTER_CONFIRM) {
+                filter->tracking = 1;
+                filter->range = median;
+                filter->obstacleSpeed = 0.0f;
+                filter->outliers = 0;
+            }
+        }
+        else if (residual > RANGE_FILTER_GATE_MM || residual < -RANGE_FILTER_GATE_MM) {
+            // A different obstacle (or none) if it keeps up: restart the track there
+            if (++filter->outliers >= RANGE_FILTER_MAX_OUTLIERS) {
+                filter->range = median;
+                filter->obstacleSpeed = 0.0f;
+                filter->outliers = 0;
+            }
+        }
+        else {
+            filter->outliers = 0;
+            filter->range += RANGE_FILTER_ALPHA * residual;
+
+            if (dt > 0.0f) {
+                filter->obstacleSpeed += RANGE_FILTER_BETA * residual / dt;
+            }
+        }
+    }
+
+    range_output_t output;
+    memset(&output, 0, sizeof(output));
+    output.sequence = reading->sequence;
+    output.time_us = reading->time_us;
+    output.tracking = filter->tracking;
+    output.ttc_ms = RANGE_FILTER_NO_COLLISION;
+
+    if (filter->tracking) {
+        float closing = ownSpeed - filter->obstacleSpeed;
+        float range = filter->range < 0.0f ? 0.0f : filter->range;
+
+        output.range_mm = (int32_t)range;
+        output.closing_mm_s = (int32_t)closing;
+
+        if (closing > 0.0f) {
+            output.ttc_ms = (uint32_t)(range * 1000.0f / closing);
+            output.braking_mm = range_filter_braking_mm(output.closing_mm_s);
+        }
+
+        output.stop = output.range_mm <= RANGE_FILTER_MIN_GAP_MM + output.braking_mm;
+    }
+
+    publishOutput(filter, &output);
+}
+
+/**
+ * @brief Gets the output for the latest reading fed in.
+ *
+ * The range, closing speed, time to collision and stop flag always come from
+ * the same reading, even if range_filter_update() runs in between. Call from
+ * task context, not from an interrupt.
+ *
+ * @param filter Filter to read.
+ * @param output Filled with the output.
+ */
+void range_filter_get_output(range_filter_t *filter, range_output_t *output) {
+    uint32_t sequence;
+
+    do {
+        sequence = seqlock_read_begin(&filter->publishLock);
+        *output = filter->published;
+    } while (seqlock_read_retry(&filter->publishLock, sequence));
+}
+
+/*** End of file ***/
@@ -1,102 +1,623 @@
-/** 
+/**
  * @file ultrasonic.c
  *
  * @brief Implements functions for interfacing with an ultrasonic sensor.
- * 
+ *
  * This module contains the implementation of functions necessary for
  * initializing and using an ultrasonic sensor. It includes sensor initialization,
- * triggering pulse, distance measurement, and handling GPIO interrupts.
+ * triggering pulse, echo timing, and handling GPIO interrupts.
+ *
+ * Each trigger starts a numbered ping. The echo pin interrupts on both edges;
+ * the handler only stores edge times and, when the echo of the open ping ends,
+ * completes the ping and wakes the task waiting in ultrasonic_process(). That
+ * task turns the echo into a distance and posts it to the subscribers. The
+ * handler never waits for the echo to end.
+ *
+ * The ranging engine (ultrasonic_start()) triggers from a repeating timer. A
+ * slot is skipped while an echo is still coming back or the blanking window
+ * after it has not passed, and a ping that got no echo by the next trigger is
+ * completed as out of range. The end of each 10 us trigger is a one-shot alarm.
+ *
+ * With several sensors each has the state above. The engine fires one group
+ * per slot. Besides the checks above, with more than one group it waits
+ * ULTRASONIC_TIMEOUT plus blanking after the last trigger, as later
+ * reflections of that ping can come back that long after the first echo has
+ * ended. The echo interrupt finds its sensor by pin.
  */
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "hardware/ultrasonic.h"
 #include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/seqlock.h"
 #include "pico/stdlib.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "queue.h"
 
-// Global variables to store measurement data
-uint64_t width;
-int successful_pulse;
-absolute_time_t start_time;
-absolute_time_t end_time;
 uint ultrasonic_distance = -1;  // Default value indicating error or no measurement
 
+// State of one sensor
+struct sensorState {
+    ultrasonic_sensor_t config;
+
+    // Rising edge time of the echo in progress, and whether there is one
+    volatile uint32_t echoStartUs;
+    volatile int echoStarted;
+    volatile uint32_t lastEchoEndUs;
+
+    // Ping waiting for its echo: its number, when it was triggered, and whether it is still open
+    volatile uint32_t pingSequence;
+    volatile uint32_t triggerUs;
+    volatile int pingOpen;
+
+    // Last completed ping, published by setting completedSequence after the other fields
+    volatile uint32_t completedSequence;
+    volatile uint32_t completedWidthUs;
+    volatile uint32_t completedEndUs;
+    volatile uint8_t completedValid;
+    uint32_t processedSequence;
+};
+
+static struct sensorState sensors[ULTRASONIC_MAX_SENSORS];
+static int sensorCount = 0;
+static int groupCount = 0;
+
+// Group the engine fired last, and when
+static int activeGroup = -1;
+static volatile uint32_t groupTriggerUs = 0;
+
+// Newest reading of every sensor, for readers that poll, and its lock
+static ultrasonic_event_t rangeTable[ULTRASONIC_MAX_SENSORS];
+static seqlock_t tableLock;
+
+// Ranging engine
+static repeating_timer_t rangingTimer;
+static int rangingRunning = 0;
+static uint32_t blankingUs = ULTRASONIC_BLANKING_US;
+static volatile uint32_t skippedSlots = 0;
+
+// Longest time spent in the echo interrupt handler, in microseconds
+static volatile uint32_t ultrasonicIsrMaxUs = 0;
+
+// Task that turns echoes into distances, woken by a task notification
+static TaskHandle_t echoTask = NULL;
+
+// One bounded event queue per subscriber; each subscriber sees every reading
+static QueueHandle_t subscriberQueues[ULTRASONIC_MAX_SUBSCRIBERS];
+static volatile uint32_t droppedEvents[ULTRASONIC_MAX_SUBSCRIBERS];
+static volatile int subscriberCount = 0;
+
 /**
- * Retrieves the last measured ultrasonic distance.
- * 
+ * Retrieves the last measured ultrasonic distance of the first sensor.
+ *
  * @param params Optional parameters (unused in this function).
- * @return The measured ultrasonic distance.
+ * @return The measured ultrasonic distance in cm, or -1 if the last ping had no echo in range.
  */
 uint getUltrasonicFinalResult(void *params) {
     return ultrasonic_distance;
 }
 
 /**
- * Initializes the GPIO pins used by the ultrasonic sensor.
+ * Sets up the sensors the engine schedules, and their GPIO pins.
+ *
+ * Call before ultrasonic_start() and before the echo interrupts are enabled.
+ * Groups should be numbered from 0 without gaps.
+ *
+ * @param config Sensors; the index of each is its number in readings.
+ * @param count Number of sensors, up to ULTRASONIC_MAX_SENSORS.
+ */
+void ultrasonic_init_sensors(const ultrasonic_sensor_t *config, int count) {
+    if (count > ULTRASONIC_MAX_SENSORS) {
+        count = ULTRASONIC_MAX_SENSORS;
+    }
+
+    memset(sensors, 0, sizeof(sensors));
+    memset(rangeTable, 0, sizeof(rangeTable));
+    groupCount = 0;
+    activeGroup = -1;
+
+    for (int i = 0; i < count; i++) {
+        struct sensorState *sensor = &sensors[i];
+        sensor->config = config[i];
+        rangeTable[i].sensor = (uint8_t)i;
+
+        if (config[i].group >= groupCount) {
+            groupCount = config[i].group + 1;
+        }
+
+        gpio_init(config[i].echoPin);
+        gpio_init(config[i].trigPin);
+
+        gpio_set_dir(config[i].echoPin, GPIO_IN);
+        gpio_set_dir(config[i].trigPin, GPIO_OUT);
+    }
+
+    sensorCount = count;
+}
+
+/**
+ * Gets how many sensors are set up.
+ *
+ * @return Sensors given to ultrasonic_init_sensors().
+ */
+int ultrasonic_get_sensor_count(void) {
+    return sensorCount;
+}
+
+/**
+ * Initializes the GPIO pins used by the front ultrasonic sensor, as the only sensor.
  *
  * @param params Optional parameters (unused in this function).
  */
 void initUltrasonic(void *params) {
-    gpio_init(ULTRASONIC_ECHO);
-    gpio_init(ULTRASONIC_TRIG);
+    static const ultrasonic_sensor_t front = {ULTRASONIC_TRIG, ULTRASONIC_ECHO, 0, 0};
+    ultrasonic_init_sensors(&front, 1);
+}
 
-    gpio_set_dir(ULTRASONIC_ECHO, GPIO_IN);
-    gpio_set_dir(ULTRASONIC_TRIG, GPIO_OUT);
+/**
+ * Ends the trigger pulses of a group; alarm callback.
+ *
+ * @param id Alarm (unused).
+ * @param userData Group number.
+ * @return 0, so the alarm does not repeat.
+ */
+static int64_t endTrigger(alarm_id_t id, void *userData) {
+    int group = (int)(intptr_t)userData;
+
+    for (int i = 0; i < sensorCount; i++) {
+        if (sensors[i].config.group == group) {
+            gpio_put(sensors[i].config.trigPin, 0);
+        }
+    }
+    return 0;
 }
 
 /**
- * Triggers the ultrasonic sensor to emit a pulse.
+ * Completes a sensor's open ping. Call with the ping's interrupts masked, or from them.
+ *
+ * @param sensor Sensor of the ping.
+ * @param widthUs Echo width, if valid.
+ * @param endUs When the echo ended, or when the ping was given up.
+ * @param valid 0 if there was no echo in range.
+ */
+static void completePing(struct sensorState *sensor, uint32_t widthUs, uint32_t endUs, int valid) {
+    sensor->completedWidthUs = widthUs;
+    sensor->completedEndUs = endUs;
+    sensor->completedValid = (uint8_t)valid;
+    __compiler_memory_barrier();
+    sensor->completedSequence = sensor->pingSequence;
+    sensor->pingOpen = 0;
+}
+
+/**
+ * Starts a new ping on every sensor of a group, with one ULTRASONIC_TRIGGER_US
+ * trigger pulse. Call with the pings' interrupts masked, or from them.
+ *
+ * @param group Group to fire.
+ * @param now Current time, 32-bit microseconds.
+ */
+static void startGroup(int group, uint32_t now) {
+    for (int i = 0; i < sensorCount; i++) {
+        struct sensorState *sensor = &sensors[i];
+
+        if (sensor->config.group == group) {
+            sensor->triggerUs = now;
+            sensor->pingSequence++;
+            sensor->pingOpen = 1;
+            gpio_put(sensor->config.trigPin, 1);
+        }
+    }
+
+    activeGroup = group;
+    groupTriggerUs = now;
+
+    if (add_alarm_in_us(ULTRASONIC_TRIGGER_US, endTrigger, (void *)(intptr_t)group, true) < 0) {
+        // No alarm free: end the pulses here rather than leave them high
+        busy_wait_us_32(ULTRASONIC_TRIGGER_US);
+        endTrigger(0, (void *)(intptr_t)group);
+    }
+}
+
+/**
+ * Triggers the first sensor's group to emit a pulse.
+ *
+ * For a single ping from a task; with the ranging engine running, it triggers
+ * by itself. Follow with ultrasonic_process().
  *
  * @param params Optional parameters (unused in this function).
  */
 void pulseUltrasonic(void *params) {
-    gpio_put(ULTRASONIC_TRIG, 1);
-    vTaskDelay(1);  // Delay to ensure ultrasonic pulse is sent
-    gpio_put(ULTRASONIC_TRIG, 0);
+    if (sensorCount == 0) {
+        return;
+    }
+
+    uint32_t status = save_and_disable_interrupts();
+    startGroup(sensors[0].config.group, time_us_32());
+    restore_interrupts(status);
 }
 
 /**
- * Measures the distance using the ultrasonic sensor.
+ * Repeating timer callback of the ranging engine: fires the next group.
  *
- * @param params Optional parameters (unused in this function).
- * @return The measured distance or -1 if the measurement failed.
+ * @param timer The repeating timer (unused).
+ * @return true to keep the timer running.
  */
-uint64_t getDistanceUltrasonic(void *params) {
-    width = 0;
-    successful_pulse = 0;
+static bool rangingTick(repeating_timer_t *timer) {
+    uint32_t now = time_us_32();
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    int completed = 0;
 
-    start_time = get_absolute_time();
+    if (sensorCount == 0) {
+        return true;
+    }
 
-    while (gpio_get(ULTRASONIC_ECHO) == 1) {
-        width++;
+    // An echo is still coming back, or its reverberation may still be: skip this slot,
+    // since any sensor fired now could hear it
+    for (int i = 0; i < sensorCount; i++) {
+        struct sensorState *sensor = &sensors[i];
 
-        if (width > ULTRASONIC_TIMEOUT) {
-            successful_pulse = 0;
+        if ((sensor->echoStarted && now - sensor->echoStartUs <= ULTRASONIC_TIMEOUT) ||
+            now - sensor->lastEchoEndUs < blankingUs) {
+            skippedSlots++;
+            return true;
         }
-        else {
-            successful_pulse = 1;
+    }
+
+    // Another group's sensors could still hear reflections of the last ping
+    if (groupCount > 1 && now - groupTriggerUs < ULTRASONIC_TIMEOUT + blankingUs) {
+        skippedSlots++;
+        return true;
+    }
+
+    for (int i = 0; i < sensorCount; i++) {
+        if (sensors[i].pingOpen) {
+            completePing(&sensors[i], 0, now, 0);
+            completed = 1;
         }
     }
 
-    if (successful_pulse == 1) {
-        end_time = get_absolute_time();
-        ultrasonic_distance = absolute_time_diff_us(start_time, end_time) / 29 / 2; // Calculate distance based on time difference
+    if (completed && echoTask != NULL) {
+        vTaskNotifyGiveFromISR(echoTask, &higherPriorityTaskWoken);
+    }
+
+    startGroup((activeGroup + 1) % groupCount, now);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+    return true;
+}
 
-        return ultrasonic_distance;
+/**
+ * Starts the ranging engine.
+ *
+ * Call after initUltrasonic() or ultrasonic_init_sensors(), and have one task
+ * loop on ultrasonic_process(). Each slot fires the next group, so each sensor
+ * gets rateHz divided by the number of groups. Slots are skipped while an echo
+ * is still high and for blanking after it, so the rate reached is lower with
+ * nothing in range than with a close obstacle. With more than one group, slots
+ * are also skipped until ULTRASONIC_TIMEOUT plus blanking after the last
+ * trigger, which caps the slots taken at about 35 per second.
+ *
+ * @param rateHz Slots per second to aim for.
+ * @param blanking Quiet time after each echo before the next trigger, in microseconds.
+ */
+void ultrasonic_start(uint32_t rateHz, uint32_t blanking) {
+    if (rangingRunning) {
+        cancel_repeating_timer(&rangingTimer);
     }
-    else {
-        return -1;  // Indicates measurement failure
+
+    blankingUs = blanking;
+    // A negative period keeps triggers evenly spaced, however long a tick takes
+    add_repeating_timer_us(-(int64_t)(1000000 / rateHz), rangingTick, NULL, &rangingTimer);
+    rangingRunning = 1;
+}
+
+/**
+ * Stops the ranging engine.
+ */
+void ultrasonic_stop(void) {
+    if (rangingRunning) {
+        cancel_repeating_timer(&rangingTimer);
+        rangingRunning = 0;
     }
 }
 
 /**
- * GPIO callback function for ultrasonic sensor interrupts.
+ * GPIO callback function for ultrasonic sensor interrupts, on both echo edges.
+ *
+ * Stores the edge time only; ultrasonic_process() does the rest in its task.
  *
- * @param gpio GPIO number.
+ * @param gpio GPIO number; pins that are not a sensor's echo are ignored.
  * @param events Type of event that triggered the interrupt.
  */
 void gpio_callback_ultrasonic(uint gpio, uint32_t events) {
-    getDistanceUltrasonic(NULL);
+    uint32_t now = time_us_32();
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    struct sensorState *sensor = NULL;
+
+    for (int i = 0; i < sensorCount; i++) {
+        if (sensors[i].config.echoPin == gpio) {
+            sensor = &sensors[i];
+            break;
+        }
+    }
+
+    if (sensor == NULL) {
+        return;
+    }
+
+    if (events & GPIO_IRQ_EDGE_RISE) {
+        sensor->echoStartUs = now;
+        sensor->echoStarted = 1;
+    }
+
+    if ((events & GPIO_IRQ_EDGE_FALL) && sensor->echoStarted) {
+        uint32_t width = now - sensor->echoStartUs;
+        sensor->echoStarted = 0;
+        sensor->lastEchoEndUs = now;
+
+        // Only an echo that started after the trigger belongs to the open ping
+        if (sensor->pingOpen && (int32_t)(sensor->echoStartUs - sensor->triggerUs) >= 0) {
+            completePing(sensor, width, now, width <= ULTRASONIC_TIMEOUT);
+
+            if (echoTask != NULL) {
+                vTaskNotifyGiveFromISR(echoTask, &higherPriorityTaskWoken);
+            }
+        }
+    }
+
+    uint32_t elapsed = time_us_32() - now;
+
+    if (elapsed > ultrasonicIsrMaxUs) {
+        ultrasonicIsrMaxUs = elapsed;
+    }
+
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/**
+ * Posts a reading to every subscriber. A subscriber whose queue is full loses
+ * its oldest reading, so it always catches up to the newest ones.
+ *
+ * @param event Reading to post.
+ */
+static void publishReading(const ultrasonic_event_t *event) {
+    for (int subscriber = 0; subscriber < subscriberCount; subscriber++) {
+        QueueHandle_t queue = subscriberQueues[subscriber];
+
+        if (xQueueSend(queue, event, 0) != pdTRUE) {
+            ultrasonic_event_t oldest;
+            xQueueReceive(queue, &oldest, 0);
+            xQueueSend(queue, event, 0);
+            droppedEvents[subscriber]++;
+        }
+    }
+}
+
+/**
+ * Checks whether any sensor has a completed ping not yet processed.
+ */
+static int pingsWaiting(void) {
+    for (int i = 0; i < sensorCount; i++) {
+        if (sensors[i].completedSequence != sensors[i].processedSequence) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Waits for the next completed pings and turns them into distances.
+ *
+ * Call from one task. Each distance is stored in the range table, for
+ * ultrasonic_get_reading() and ultrasonic_get_range_table(), and posted to
+ * every subscriber; the first sensor's also for getUltrasonicFinalResult(). No
+ * echo, or one longer than ULTRASONIC_TIMEOUT, reads as out of range. Without
+ * the ranging engine, pings from pulseUltrasonic() still open after timeout
+ * are given up.
+ *
+ * @param timeout Ticks to wait for a ping to complete.
+ * @return Number of new readings with an echo in range.
+ */
+int ultrasonic_process(uint32_t timeout) {
+    echoTask = xTaskGetCurrentTaskHandle();
+
+    // Always take the notification, so pings read here do not wake the next call
+    uint32_t woken = ulTaskNotifyTake(pdTRUE, pingsWaiting() ? 0 : timeout);
+
+    if (woken == 0 && !pingsWaiting()) {
+        uint32_t status = save_and_disable_interrupts();
+
+        for (int i = 0; i < sensorCount; i++) {
+            if (!rangingRunning && sensors[i].pingOpen) {
+                completePing(&sensors[i], 0, time_us_32(), 0);
+            }
+        }
+        restore_interrupts(status);
+    }
+
+    ultrasonic_event_t events[ULTRASONIC_MAX_SENSORS];
+    int count = 0;
+    int inRange = 0;
+
+    for (int i = 0; i < sensorCount; i++) {
+        struct sensorState *sensor = &sensors[i];
+        ultrasonic_event_t *event = &events[count];
+        uint32_t sequence;
+        memset(event, 0, sizeof(*event));
+
+        // The interrupts complete pings while this runs, so read until the number holds
+        do {
+            sequence = sensor->completedSequence;
+            __compiler_memory_barrier();
+            event->echo_us = sensor->completedWidthUs;
+            event->time_us = sensor->completedEndUs;
+            event->valid = sensor->completedValid;
+            __compiler_memory_barrier();
+        } while (sequence != sensor->completedSequence);
+
+        if (sequence == sensor->processedSequence) {
+            continue;
+        }
+
+        sensor->processedSequence = sequence;
+        event->sensor = (uint8_t)i;
+        event->sequence = sequence;
+
+        if (event->valid) {
+            // Sound covers about 1 cm every 29 us, there and back
+            event->distance_mm = event->echo_us * 10 / (ULTRASONIC_US_PER_CM * 2);
+            inRange++;
+        }
+        else {
+            event->echo_us = 0;
+        }
+
+        if (i == 0) {
+            ultrasonic_distance = event->valid ? event->echo_us / ULTRASONIC_US_PER_CM / 2 : (uint)-1;
+        }
+        count++;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    // One update for every sensor that completed, so a group is published together
+    seqlock_write_begin(&tableLock);
+    for (int k = 0; k < count; k++) {
+        rangeTable[events[k].sensor] = events[k];
+    }
+    seqlock_write_end(&tableLock);
+
+    for (int k = 0; k < count; k++) {
+        publishReading(&events[k]);
+    }
+
+    return inRange;
+}
+
+/**
+ * Gets a sensor's newest reading without waiting.
+ *
+ * Compare its sequence number with the previous one to tell whether a new
+ * range arrived, and how many pings were missed in between.
+ *
+ * @param sensor Sensor number.
+ * @param reading Filled with the reading; sequence 0 before the first one.
+ */
+void ultrasonic_get_reading(int sensor, ultrasonic_event_t *reading) {
+    uint32_t sequence;
+
+    if (sensor < 0 || sensor >= ULTRASONIC_MAX_SENSORS) {
+        memset(reading, 0, sizeof(*reading));
+        return;
+    }
+
+    do {
+        sequence = seqlock_read_begin(&tableLock);
+        *reading = rangeTable[sensor];
+    } while (seqlock_read_retry(&tableLock, sequence));
+}
+
+/**
+ * Gets every sensor's newest reading at once, without waiting.
+ *
+ * The copy is taken as one piece, so readings processed together (such as the
+ * sensors of one group) are never mixed with older ones.
+ *
+ * @param table Filled with one reading per sensor, by sensor number.
+ * @return Number of sensors filled in.
+ */
+int ultrasonic_get_range_table(ultrasonic_event_t table[ULTRASONIC_MAX_SENSORS]) {
+    uint32_t sequence;
+
+    do {
+        sequence = seqlock_read_begin(&tableLock);
+        memcpy(table, rangeTable, sizeof(rangeTable));
+    } while (seqlock_read_retry(&tableLock, sequence));
+
+    return sensorCount;
+}
+
+/**
+ * Gets how many trigger slots the ranging engine skipped because an echo was
+ * still high or inside its blanking window.
+ *
+ * @return Slots skipped since boot.
+ */
+uint32_t ultrasonic_get_skipped_slots(void) {
+    return skippedSlots;
+}
+
+/**
+ * Registers a new consumer of ultrasonic readings.
+ *
+ * @return Its subscriber number, or -1 if ULTRASONIC_MAX_SUBSCRIBERS are
+ *         already registered.
+ */
+int ultrasonic_subscribe(void) {
+    QueueHandle_t queue = xQueueCreate(ULTRASONIC_EVENT_QUEUE_DEPTH, sizeof(ultrasonic_event_t));
+
+    if (queue == NULL) {
+        return -1;
+    }
+
+    taskENTER_CRITICAL();
+    int subscriber = subscriberCount;
+
+    if (subscriber < ULTRASONIC_MAX_SUBSCRIBERS) {
+        subscriberQueues[subscriber] = queue;
+        droppedEvents[subscriber] = 0;
+        subscriberCount = subscriber + 1;
+    }
+    taskEXIT_CRITICAL();
+
+    if (subscriber >= ULTRASONIC_MAX_SUBSCRIBERS) {
+        vQueueDelete(queue);
+        return -1;
+    }
+
+    return subscriber;
+}
+
+/**
+ * Waits for a subscriber's next reading.
+ *
+ * @param subscriber Number from ultrasonic_subscribe().
+ * @param event Filled with the reading.
+ * @param timeout Ticks to wait, 0 to poll.
+ * @return 1 if a reading was received, otherwise 0.
+ */
+int ultrasonic_get_event(int subscriber, ultrasonic_event_t *event, uint32_t timeout) {
+    if (subscriber < 0 || subscriber >= subscriberCount) {
+        return 0;
+    }
+
+    return xQueueReceive(subscriberQueues[subscriber], event, timeout) == pdTRUE;
+}
+
+/**
+ * Gets how many readings a subscriber lost because its queue was full.
+ *
+ * @param subscriber Number from ultrasonic_subscribe().
+ * @return Readings dropped.
+ */
+uint32_t ultrasonic_get_dropped_events(int subscriber) {
+    if (subscriber < 0 || subscriber >= subscriberCount) {
+        return 0;
+    }
+
+    return droppedEvents[subscriber];
+}
+
+/**
+ * Gets the longest time spent in the echo interrupt handler.
+ *
+ * @return Worst case in microseconds.
+ */
+uint32_t ultrasonic_get_isr_max_us(void) {
+    return ultrasonicIsrMaxUs;
 }
 
 /*** End of file ***/
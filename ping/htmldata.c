@@ -45,73 +45,122 @@ static const unsigned char data_index_shtml[] = {
 	0x20, 0x3c, 0x70, 0x3e, 0x42, 0x61, 0x72, 0x63, 0x6f, 0x64, 
 	0x65, 0x3a, 0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x23, 0x63, 0x6f, 
 	0x64, 0x65, 0x2d, 0x2d, 0x3e, 0x3c, 0x2f, 0x70, 0x3e, 0x0a, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x64, 0x69, 0x76, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x62, 0x72, 0x3e, 0x0a, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x68, 0x32, 0x20, 0x73, 
-	0x74, 0x79, 0x6c, 0x65, 0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 
-	0x2d, 0x61, 0x6c, 0x69, 0x67, 0x6e, 0x3a, 0x20, 0x63, 0x65, 
-	0x6e, 0x74, 0x65, 0x72, 0x3b, 0x22, 0x3e, 0x49, 0x6e, 0x70, 
-	0x75, 0x74, 0x20, 0x66, 0x72, 0x6f, 0x6d, 0x20, 0x4c, 0x61, 
-	0x70, 0x74, 0x6f, 0x70, 0x3c, 0x2f, 0x68, 0x32, 0x3e, 0x0a, 
-	0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x64, 0x69, 0x76, 0x20, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x3d, 
-	0x22, 0x74, 0x65, 0x78, 0x74, 0x2d, 0x61, 0x6c, 0x69, 0x67, 
-	0x6e, 0x3a, 0x20, 0x63, 0x65, 0x6e, 0x74, 0x65, 0x72, 0x22, 
-	0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x64, 0x69, 0x76, 0x20, 0x73, 
-	0x74, 0x79, 0x6c, 0x65, 0x3d, 0x22, 0x61, 0x6c, 0x69, 0x67, 
-	0x6e, 0x2d, 0x69, 0x74, 0x65, 0x6d, 0x73, 0x3a, 0x20, 0x63, 
-	0x65, 0x6e, 0x74, 0x65, 0x72, 0x3b, 0x22, 0x3e, 0x0a, 0x20, 
 	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x61, 0x20, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 
-	0x2f, 0x6c, 0x65, 0x64, 0x2e, 0x63, 0x67, 0x69, 0x3f, 0x6c, 
-	0x65, 0x64, 0x3d, 0x31, 0x22, 0x3e, 0x3c, 0x62, 0x75, 0x74, 
-	0x74, 0x6f, 0x6e, 0x3e, 0x53, 0x74, 0x61, 0x72, 0x74, 0x3c, 
-	0x2f, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x3c, 0x2f, 
-	0x61, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x61, 0x20, 0x68, 0x72, 
-	0x65, 0x66, 0x3d, 0x22, 0x2f, 0x6c, 0x65, 0x64, 0x2e, 0x63, 
-	0x67, 0x69, 0x3f, 0x6c, 0x65, 0x64, 0x3d, 0x30, 0x22, 0x3e, 
-	0x3c, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x53, 0x74, 
-	0x6f, 0x70, 0x3c, 0x2f, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 
-	0x3e, 0x3c, 0x2f, 0x61, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x64, 0x69, 0x76, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x62, 0x72, 
+	0x20, 0x20, 0x3c, 0x70, 0x3e, 0x42, 0x61, 0x72, 0x63, 0x6f, 
+	0x64, 0x65, 0x20, 0x49, 0x52, 0x51, 0x73, 0x2f, 0x73, 0x3a, 
+	0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x23, 0x62, 0x63, 0x69, 0x72, 
+	0x71, 0x2d, 0x2d, 0x3e, 0x3c, 0x2f, 0x70, 0x3e, 0x0a, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x3c, 0x70, 0x3e, 0x42, 0x61, 0x72, 0x63, 0x6f, 0x64, 
+	0x65, 0x20, 0x77, 0x6f, 0x72, 0x73, 0x74, 0x2d, 0x63, 0x61, 
+	0x73, 0x65, 0x20, 0x49, 0x53, 0x52, 0x20, 0x28, 0x75, 0x73, 
+	0x29, 0x3a, 0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x23, 0x62, 0x63, 
+	0x69, 0x73, 0x72, 0x2d, 0x2d, 0x3e, 0x3c, 0x2f, 0x70, 0x3e, 
+	0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x3c, 0x70, 0x3e, 0x42, 0x61, 0x72, 0x63, 
+	0x6f, 0x64, 0x65, 0x20, 0x64, 0x72, 0x6f, 0x70, 0x70, 0x65, 
+	0x64, 0x20, 0x63, 0x61, 0x70, 0x74, 0x75, 0x72, 0x65, 0x20, 
+	0x62, 0x6c, 0x6f, 0x63, 0x6b, 0x73, 0x3a, 0x20, 0x3c, 0x21, 
+	0x2d, 0x2d, 0x23, 0x62, 0x63, 0x64, 0x72, 0x6f, 0x70, 0x2d, 
+	0x2d, 0x3e, 0x3c, 0x2f, 0x70, 0x3e, 0x0a, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
+	0x70, 0x3e, 0x42, 0x61, 0x72, 0x63, 0x6f, 0x64, 0x65, 0x20, 
+	0x74, 0x68, 0x72, 0x65, 0x73, 0x68, 0x6f, 0x6c, 0x64, 0x3a, 
+	0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x23, 0x62, 0x63, 0x74, 0x68, 
+	0x72, 0x2d, 0x2d, 0x3e, 0x3c, 0x2f, 0x70, 0x3e, 0x0a, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x3c, 0x70, 0x3e, 0x49, 0x52, 0x20, 0x6c, 0x69, 0x6e, 
+	0x65, 0x20, 0x74, 0x68, 0x72, 0x65, 0x73, 0x68, 0x6f, 0x6c, 
+	0x64, 0x73, 0x3a, 0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x23, 0x69, 
+	0x72, 0x74, 0x68, 0x72, 0x2d, 0x2d, 0x3e, 0x3c, 0x2f, 0x70, 
 	0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x66, 0x6f, 
-	0x72, 0x6d, 0x20, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x3d, 
-	0x22, 0x2f, 0x74, 0x65, 0x78, 0x74, 0x2e, 0x63, 0x67, 0x69, 
-	0x22, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x3e, 0x50, 0x6f, 0x73, 
+	0x65, 0x3a, 0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x23, 0x70, 0x6f, 
+	0x73, 0x65, 0x2d, 0x2d, 0x3e, 0x3c, 0x2f, 0x70, 0x3e, 0x0a, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x3c, 0x70, 0x3e, 0x55, 0x6c, 0x74, 0x72, 0x61, 
+	0x73, 0x6f, 0x6e, 0x69, 0x63, 0x20, 0x77, 0x6f, 0x72, 0x73, 
+	0x74, 0x2d, 0x63, 0x61, 0x73, 0x65, 0x20, 0x49, 0x53, 0x52, 
+	0x20, 0x28, 0x75, 0x73, 0x29, 0x3a, 0x20, 0x3c, 0x21, 0x2d, 
+	0x2d, 0x23, 0x75, 0x73, 0x69, 0x73, 0x72, 0x2d, 0x2d, 0x3e, 
+	0x3c, 0x2f, 0x70, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x3e, 
+	0x45, 0x6d, 0x65, 0x72, 0x67, 0x65, 0x6e, 0x63, 0x79, 0x20, 
+	0x73, 0x74, 0x6f, 0x70, 0x73, 0x3a, 0x20, 0x3c, 0x21, 0x2d, 
+	0x2d, 0x23, 0x65, 0x73, 0x74, 0x6f, 0x70, 0x2d, 0x2d, 0x3e, 
+	0x3c, 0x2f, 0x70, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x3e, 
+	0x55, 0x6c, 0x74, 0x72, 0x61, 0x73, 0x6f, 0x6e, 0x69, 0x63, 
+	0x20, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x73, 0x3a, 0x20, 0x3c, 
+	0x21, 0x2d, 0x2d, 0x23, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x73, 
+	0x2d, 0x2d, 0x3e, 0x3c, 0x2f, 0x70, 0x3e, 0x0a, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x64, 0x69, 
+	0x76, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x3c, 0x62, 0x72, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x3c, 0x68, 0x32, 0x20, 0x73, 0x74, 0x79, 
+	0x6c, 0x65, 0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x2d, 0x61, 
+	0x6c, 0x69, 0x67, 0x6e, 0x3a, 0x20, 0x63, 0x65, 0x6e, 0x74, 
+	0x65, 0x72, 0x3b, 0x22, 0x3e, 0x49, 0x6e, 0x70, 0x75, 0x74, 
+	0x20, 0x66, 0x72, 0x6f, 0x6d, 0x20, 0x4c, 0x61, 0x70, 0x74, 
+	0x6f, 0x70, 0x3c, 0x2f, 0x68, 0x32, 0x3e, 0x0a, 0x0a, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x64, 0x69, 
+	0x76, 0x20, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x3d, 0x22, 0x74, 
+	0x65, 0x78, 0x74, 0x2d, 0x61, 0x6c, 0x69, 0x67, 0x6e, 0x3a, 
+	0x20, 0x63, 0x65, 0x6e, 0x74, 0x65, 0x72, 0x22, 0x3e, 0x0a, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x3c, 0x64, 0x69, 0x76, 0x20, 0x73, 0x74, 0x79, 
+	0x6c, 0x65, 0x3d, 0x22, 0x61, 0x6c, 0x69, 0x67, 0x6e, 0x2d, 
+	0x69, 0x74, 0x65, 0x6d, 0x73, 0x3a, 0x20, 0x63, 0x65, 0x6e, 
+	0x74, 0x65, 0x72, 0x3b, 0x22, 0x3e, 0x0a, 0x20, 0x20, 0x20, 
 	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 
-	0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 0x20, 0x69, 0x64, 
-	0x3d, 0x22, 0x73, 0x6e, 0x61, 0x6d, 0x65, 0x22, 0x20, 0x6e, 
-	0x61, 0x6d, 0x65, 0x3d, 0x22, 0x73, 0x6e, 0x61, 0x6d, 0x65, 
-	0x22, 0x3e, 0x3c, 0x62, 0x72, 0x3e, 0x3c, 0x62, 0x72, 0x3e, 
+	0x61, 0x20, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 0x2f, 0x6c, 
+	0x65, 0x64, 0x2e, 0x63, 0x67, 0x69, 0x3f, 0x6c, 0x65, 0x64, 
+	0x3d, 0x31, 0x22, 0x3e, 0x3c, 0x62, 0x75, 0x74, 0x74, 0x6f, 
+	0x6e, 0x3e, 0x53, 0x74, 0x61, 0x72, 0x74, 0x3c, 0x2f, 0x62, 
+	0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x3c, 0x2f, 0x61, 0x3e, 
+	0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x3c, 0x61, 0x20, 0x68, 0x72, 0x65, 0x66, 
+	0x3d, 0x22, 0x2f, 0x6c, 0x65, 0x64, 0x2e, 0x63, 0x67, 0x69, 
+	0x3f, 0x6c, 0x65, 0x64, 0x3d, 0x30, 0x22, 0x3e, 0x3c, 0x62, 
+	0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x53, 0x74, 0x6f, 0x70, 
+	0x3c, 0x2f, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x3c, 
+	0x2f, 0x61, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x64, 0x69, 
+	0x76, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x62, 0x72, 0x3e, 0x0a, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x66, 0x6f, 0x72, 0x6d, 
+	0x20, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x3d, 0x22, 0x2f, 
+	0x74, 0x65, 0x78, 0x74, 0x2e, 0x63, 0x67, 0x69, 0x22, 0x3e, 
 	0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
 	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x69, 0x6e, 
 	0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d, 0x22, 
-	0x73, 0x75, 0x62, 0x6d, 0x69, 0x74, 0x22, 0x20, 0x76, 0x61, 
-	0x6c, 0x75, 0x65, 0x3d, 0x22, 0x53, 0x75, 0x62, 0x6d, 0x69, 
-	0x74, 0x22, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x66, 0x6f, 
-	0x72, 0x6d, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x2f, 0x64, 0x69, 0x76, 0x3e, 0x0a, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x0a, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x0a, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x62, 0x72, 0x3e, 0x0a, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x62, 0x72, 
+	0x74, 0x65, 0x78, 0x74, 0x22, 0x20, 0x69, 0x64, 0x3d, 0x22, 
+	0x73, 0x6e, 0x61, 0x6d, 0x65, 0x22, 0x20, 0x6e, 0x61, 0x6d, 
+	0x65, 0x3d, 0x22, 0x73, 0x6e, 0x61, 0x6d, 0x65, 0x22, 0x3e, 
+	0x3c, 0x62, 0x72, 0x3e, 0x3c, 0x62, 0x72, 0x3e, 0x0a, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x69, 0x6e, 0x70, 0x75, 
+	0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d, 0x22, 0x73, 0x75, 
+	0x62, 0x6d, 0x69, 0x74, 0x22, 0x20, 0x76, 0x61, 0x6c, 0x75, 
+	0x65, 0x3d, 0x22, 0x53, 0x75, 0x62, 0x6d, 0x69, 0x74, 0x22, 
+	0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x66, 0x6f, 0x72, 0x6d, 
 	0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x61, 0x20, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 0x2f, 
-	0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e, 0x73, 0x68, 0x74, 0x6d, 
-	0x6c, 0x22, 0x3e, 0x52, 0x65, 0x66, 0x72, 0x65, 0x73, 0x68, 
-	0x3c, 0x2f, 0x61, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x62, 0x6f, 0x64, 0x79, 0x3e, 0x0a, 0x3c, 0x2f, 0x68, 0x74, 
-	0x6d, 0x6c, 0x3e, 0x0a, };
+	0x3c, 0x2f, 0x64, 0x69, 0x76, 0x3e, 0x0a, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x3c, 0x62, 0x72, 0x3e, 0x0a, 0x20, 0x20, 0x20, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x62, 0x72, 0x3e, 0x0a, 
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x61, 
+	0x20, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 0x2f, 0x69, 0x6e, 
+	0x64, 0x65, 0x78, 0x2e, 0x73, 0x68, 0x74, 0x6d, 0x6c, 0x22, 
+	0x3e, 0x52, 0x65, 0x66, 0x72, 0x65, 0x73, 0x68, 0x3c, 0x2f, 
+	0x61, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x62, 0x6f, 
+	0x64, 0x79, 0x3e, 0x0a, 0x3c, 0x2f, 0x68, 0x74, 0x6d, 0x6c, 
+	0x3e, 0x0a, };
 
 const struct fsdata_file file_index_shtml[] = {{ NULL, data_index_shtml, data_index_shtml + 13, sizeof(data_index_shtml) - 13, FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT}};
 
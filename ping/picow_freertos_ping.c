@@ -40,11 +40,17 @@
 
 // Sensor libraries.
 #include "hardware/motor.h"
+#include "hardware/speed_control.h"
+#include "hardware/motor_calibration.h"
 #include "hardware/ultrasonic.h"
+#include "hardware/range_filter.h"
+#include "hardware/safety.h"
 #include "hardware/encoder.h"
 #include "hardware/irline.h"
 #include "hardware/magnetometer.h"
 #include "hardware/barcode.h"
+#include "hardware/odometry.h"
+#include "hardware/motion.h"
 
 // Wifi Configuration
 #define WIFI_SSID       "SSID"
@@ -52,68 +58,113 @@
 
 #define mbaTASK_MESSAGE_BUFFER_SIZE       ( 60 )
 
+// Wheel speeds in cm/s
+#define DRIVE_SPEED 25.0f
+#define CORRECTION_SPEED 5.0f
+#define TURN_SPEED 20.0f
+#define JUNCTION_TURN_DEGREES -90
+
+// Line following runs once per IR sample
+#define LINE_FOLLOW_PERIOD_MS 10
+
+// Ultrasonic sensors; the front one is first, as the range filter follows it.
+// Both side sensors face apart, so they share a slot.
+#define FRONT_SENSOR 0
+
+static const ultrasonic_sensor_t ultrasonicSensors[] = {
+    {ULTRASONIC_TRIG, ULTRASONIC_ECHO, 0, 0},
+#if ULTRASONIC_SIDE_SENSORS
+    {ULTRASONIC_LEFT_TRIG, ULTRASONIC_LEFT_ECHO, 1, 90},
+    {ULTRASONIC_RIGHT_TRIG, ULTRASONIC_RIGHT_ECHO, 1, -90},
+#endif
+};
+
+#define ULTRASONIC_SENSOR_COUNT (sizeof(ultrasonicSensors) / sizeof(ultrasonicSensors[0]))
+
+// Ultrasonic readings turned into a tracked range; updated by the ultrasonic task
+static range_filter_t rangeFilter;
+
 /**
  * @brief Task to control wheel movement based on sensor data.
  *
  * @param params Task parameters
  */
 void move_wheels(__unused void *params) {
-    // Initialize motor control
+    // Initialize motor control; wheel speeds are held by the speed controller
     initMotor(NULL);
 
-    setLeftSpeed(0.5);
-    setRightSpeed(0.5);
+#if MOTOR_CALIBRATE_AT_BOOT
+    // Characterize both motors and keep the fitted feedforward for the next boots
+    static motor_calibration_t calibration;
+
+    if (motor_calibrate(&calibration) == 0 && motor_calibration_save(&calibration) == 0) {
+        motor_calibration_apply(&calibration);
+        printf("Motor calibration saved: left %ld + %ld/256 per cm/s, right %ld + %ld/256 per cm/s\n",
+               (long)calibration.wheel[MOTOR_LEFT].ffOffset, (long)calibration.wheel[MOTOR_LEFT].ffSlope,
+               (long)calibration.wheel[MOTOR_RIGHT].ffOffset, (long)calibration.wheel[MOTOR_RIGHT].ffSlope);
+    }
+    else {
+        printf("Motor calibration failed\n");
+    }
+#endif
+
+    motor_speed_control_start();
+
+    // Last wheel speeds posted, so a target is only posted when it changes
+    float postedLeft = 0.0f;
+    float postedRight = 0.0f;
+    int posted = 0;
+    TickType_t lastWake = xTaskGetTickCount();
 
     while (true) {
-        // Read IR sensor data
-        int left_IR_data = getLeftIRSensorValue(NULL);
-        int right_IR_data = getRightIRSensorValue(NULL);
+        // Wait for the next IR sample; the CPU is free for the other tasks meanwhile
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(LINE_FOLLOW_PERIOD_MS));
+
+        // Read IR sensor colours (1 - black, 0 - white)
+        int left_IR_black = isLeftIRBlack(NULL);
+        int right_IR_black = isRightIRBlack(NULL);
+        float left;
+        float right;
+
+        if (safety_is_stopped()) {
+            // The safety monitor has cut the motors; post again once it releases them
+            posted = 0;
+            continue;
+        }
 
-        // If both IR sensors detect white space, move forward.
-        if (getUltrasonicFinalResult(NULL) < 15) {
-            stop(NULL);
+        // If both IR sensors detect black line, turn.
+        if (left_IR_black && right_IR_black) {
+            // Turn right on the spot; the motion task runs it while this task sleeps.
+            // The safety monitor cancels it if an obstacle comes up.
+            motion_turn(JUNCTION_TURN_DEGREES, TURN_SPEED, xTaskGetCurrentTaskHandle());
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+            // The turn ends stopped; pick up from now rather than catch up missed periods
+            posted = 0;
+            lastWake = xTaskGetTickCount();
+            continue;
         }
+        // If left IR detects black, angle right.
+        else if (left_IR_black) {
+            left = CORRECTION_SPEED;
+            right = DRIVE_SPEED;
+        }
+        // If right IR detects black, angle left.
+        else if (right_IR_black) {
+            left = DRIVE_SPEED;
+            right = CORRECTION_SPEED;
+        }
+        // If both IRs detect white, move forward; the speed controller keeps both wheels at the same speed
         else {
-            // If both IRs detect white, move forward.
-            if (left_IR_data < COLOUR_CUTOFF_VALUE && right_IR_data < COLOUR_CUTOFF_VALUE) {
-                setLeftSpeed(0.53);
-                setRightSpeed(0.5);
-                
-                moveForward(NULL);
-
-                double left_encoder_speed = getLeftSpeed(NULL);
-                double right_encoder_speed = getRightSpeed(NULL);
-
-                // Make sure both wheels are moving at the same speed.
-                if (left_encoder_speed < right_encoder_speed + 0.6) {
-                    increaseLeftSpeed(NULL);
-                }
-                if (left_encoder_speed > right_encoder_speed + 0.6) {
-                    decreaseLeftSpeed(NULL);
-                }
-            }
-            // If both IR sensors detect black line, turn.
-            else if (left_IR_data > COLOUR_CUTOFF_VALUE && right_IR_data > COLOUR_CUTOFF_VALUE) {
-                setLeftSpeed(0.5);
-                setRightSpeed(0.5);
-
-                int temp_left_notch_count = getLeftNotchCount(NULL);
-
-                // Turn right until the left wheel has turned 25 notches.
-                while ((temp_left_notch_count > (getLeftNotchCount(NULL) - 25))) {
-                    turnHardRight(NULL);
-                }
-            }
-            // If left IR detects black, angle right.
-            else if(left_IR_data > COLOUR_CUTOFF_VALUE) {
-                setLeftSpeed(0.2);
-                setRightSpeed(1);
-            }
-            // If right IR detects black, angle left.
-            else if(right_IR_data > COLOUR_CUTOFF_VALUE) {
-                setLeftSpeed(1);
-                setRightSpeed(0.2);
-            }
+            left = DRIVE_SPEED;
+            right = DRIVE_SPEED;
+        }
+
+        if (!posted || left != postedLeft || right != postedRight) {
+            // Dropped while an emergency stop is latched; posted again next period
+            posted = motor_set_target_speed(left, right) == 0;
+            postedLeft = left;
+            postedRight = right;
         }
     }
 }
@@ -135,7 +186,7 @@ void read_ir_sensor(__unused void *params) {
 }
 
 /**
- * @brief Task to continuously read barcode data.
+ * @brief Task to decode barcode data, woken by the barcode capture interrupts.
  *
  * @param params Task parameters
  */
@@ -144,9 +195,26 @@ void read_barcode(__unused void *params) {
     barcode_setup();
 
     while (true) {
-        vTaskDelay(10);
-        // Function to read barcode
-        barcode_main_loop();
+        // Sleep until the capture side reports new data, then decode it
+        barcode_process_samples(portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief Task to log every decoded barcode, blocking on its barcode event queue.
+ *
+ * @param params Task parameters
+ */
+void log_barcode(__unused void *params) {
+    int subscriber = barcode_subscribe();
+    barcode_event_t event;
+
+    while (true) {
+        if (barcode_get_event(subscriber, &event, portMAX_DELAY)) {
+            printf("Barcode: %s (confidence %u, position %lu)\n\r", event.payload, event.confidence,
+                   (unsigned long)(event.position / ENCODER_POSITION_SCALE));
+            //sendBarcodeVal(); To send barcode values to comms
+        }
     }
 }
 
@@ -157,6 +225,7 @@ void read_barcode(__unused void *params) {
  * @param events Event type that triggered the callback.
  */
 void gpio_callback(uint gpio, uint32_t events) {
+#if ENCODER_BACKEND == ENCODER_BACKEND_IRQ
     // Handle encoder inputs
     if (gpio == LEFT_ENCODER_PIN) {
         leftEncoder(NULL);
@@ -165,11 +234,10 @@ void gpio_callback(uint gpio, uint32_t events) {
     if (gpio == RIGHT_ENCODER_PIN) {
         rightEncoder(NULL);
     }
+#endif
 
-    // Handle ultrasonic sensor echo
-    if (gpio == ULTRASONIC_ECHO) {
-        getDistanceUltrasonic(NULL);
-    }
+    // Handle ultrasonic sensor echoes; other pins are ignored
+    gpio_callback_ultrasonic(gpio, events);
 }
 
 /**
@@ -178,20 +246,38 @@ void gpio_callback(uint gpio, uint32_t events) {
  * @param params Task parameters
  */
 void read_ultrasonic_sensor(__unused void *params) {
-    // Initialize ultrasonic sensor
-    initUltrasonic(NULL);
+    // Initialize ultrasonic sensors
+    ultrasonic_init_sensors(ultrasonicSensors, ULTRASONIC_SENSOR_COUNT);
+
+    // Trigger from a hardware timer; this task only turns echoes into distances.
+    // Each group of sensors gets its own slot.
+    ultrasonic_start(ULTRASONIC_RATE_HZ * (1 + ULTRASONIC_SIDE_SENSORS), ULTRASONIC_BLANKING_US);
+
+    ultrasonic_event_t reading;
+    uint32_t lastSequence = 0;
 
     while (true) {
-        vTaskDelay(10);
-        // Function to pulse ultrasonic sensor.
-        pulseUltrasonic(NULL);
-
-        int ultrasonic_distance = getUltrasonicFinalResult(NULL);
-            
-        // -1 means no successful pulse. Reset the distance to -1.
-        if (ultrasonic_distance != -1) {
-            ultrasonic_distance = -1;
+        ultrasonic_process(portMAX_DELAY);
+        ultrasonic_get_reading(FRONT_SENSOR, &reading);
+
+        if (reading.sequence == lastSequence) {
+            continue;
         }
+        lastSequence = reading.sequence;
+
+        // Own speed towards the obstacle, mean of both wheels, mm/s; encoder speeds are
+        // capped at ENCODER_MAX_SPEED_CM_S, so times 10 stays within 32 bits
+        encoder_snapshot_t encoders;
+        encoder_get_snapshot(&encoders);
+        int32_t left = (int32_t)((encoders.left.speed * 10) >> ENCODER_SPEED_FRACTION_BITS) * getLeftDirection(NULL);
+        int32_t right = (int32_t)((encoders.right.speed * 10) >> ENCODER_SPEED_FRACTION_BITS) * getRightDirection(NULL);
+
+        range_filter_update(&rangeFilter, &reading, (left + right) / 2);
+
+        // Hand the new output to the safety monitor, which stops the car if needed
+        range_output_t range;
+        range_filter_get_output(&rangeFilter, &range);
+        safety_report_range(&range);
     }
 }
 
@@ -211,16 +297,35 @@ void read_magnetometer_task(__unused void *params) {
     }
 }
 
+/**
+ * @brief Task to integrate the wheel encoders into the car's pose at ODOMETRY_RATE_HZ.
+ *
+ * @param params Task parameters (unused).
+ */
+void odometry_task(__unused void *params) {
+    odometry_init();
+    TickType_t lastWake = xTaskGetTickCount();
+
+    while (true) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(1000 / ODOMETRY_RATE_HZ));
+        odometry_update();
+    }
+}
+
 /**
  * @brief Task to set up and manage GPIO interrupts.
  *
  * @param params Task parameters (unused).
  */
 void interrupt_task(__unused void *params) {
-    // Setup GPIO interrupts
+    // Setup GPIO interrupts; the PIO encoder backend needs none
+#if ENCODER_BACKEND == ENCODER_BACKEND_IRQ
     gpio_set_irq_enabled_with_callback(LEFT_ENCODER_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &gpio_callback);
     gpio_set_irq_enabled_with_callback(RIGHT_ENCODER_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &gpio_callback);
-    gpio_set_irq_enabled_with_callback(ULTRASONIC_ECHO, GPIO_IRQ_EDGE_RISE, true, &gpio_callback);
+#endif
+    for (size_t i = 0; i < ULTRASONIC_SENSOR_COUNT; i++) {
+        gpio_set_irq_enabled_with_callback(ultrasonicSensors[i].echoPin, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &gpio_callback);
+    }
 
     while (true) {
         vTaskDelay(10);
@@ -282,6 +387,19 @@ void vLaunch(void) {
     xTaskCreate(interrupt_task, "InterruptThread", configMINIMAL_STACK_SIZE, NULL, 2, &interruptTask);
     TaskHandle_t readBarcodeTask;
     xTaskCreate(read_barcode, "ReadBarcodeThread", configMINIMAL_STACK_SIZE, NULL, 2, &readBarcodeTask);
+    TaskHandle_t logBarcodeTask;
+    // Same priority as the driving tasks, so it is not starved while they run
+    xTaskCreate(log_barcode, "LogBarcodeThread", configMINIMAL_STACK_SIZE, NULL, 2, &logBarcodeTask);
+#if BARCODE_TRACE_ENABLED
+    TaskHandle_t barcodeTraceTask;
+    xTaskCreate(barcode_trace_task, "BarcodeTraceThread", configMINIMAL_STACK_SIZE, NULL, BARCODE_TRACE_TASK_PRIORITY, &barcodeTraceTask);
+#endif
+    TaskHandle_t safetyTask;
+    xTaskCreate(safety_task, "SafetyThread", configMINIMAL_STACK_SIZE, NULL, SAFETY_TASK_PRIORITY, &safetyTask);
+    TaskHandle_t motionTask;
+    xTaskCreate(motion_task, "MotionThread", configMINIMAL_STACK_SIZE, NULL, 3, &motionTask);
+    TaskHandle_t odometryTask;
+    xTaskCreate(odometry_task, "OdometryThread", configMINIMAL_STACK_SIZE, NULL, 3, &odometryTask);
     TaskHandle_t magnetometerTask;
     xTaskCreate(read_magnetometer_task, "MagnetometerThread", configMINIMAL_STACK_SIZE, NULL, 5, &magnetometerTask);
 
@@ -299,6 +417,13 @@ int main(void)
     stdio_init_all();
     sleep_ms(3000);
     adc_init();
+
+    // Setup wheel encoders before any task reads them, and the motion queue
+    // before any task queues motion
+    initEncoder(NULL);
+    motion_init();
+    range_filter_init(&rangeFilter);
+
     vLaunch();
 
     return 0;
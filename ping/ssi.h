@@ -11,6 +11,10 @@
 #include "pico/cyw43_arch.h"
 #include "hardware/adc.h"
 #include "hardware/barcode.h"
+#include "hardware/irline.h"
+#include "hardware/odometry.h"
+#include "hardware/ultrasonic.h"
+#include "hardware/safety.h"
 
 /**
  * @brief List of Server-Side Include (SSI) tags.
@@ -18,7 +22,11 @@
  * These tags are used in HTML files and are processed by the SSI handler.
  * The tag length is limited to 8 bytes by default.
  */
-static const char * const ssi_tags[] = {"code"};
+static const char * const ssi_tags[] = {"code", "bcirq", "bcisr", "bcthr", "irthr", "pose", "usisr", "estop", "ranges", "bcdrop"};
+
+// Barcode event subscription of the web page and the newest event it has seen
+static int barcodeSubscriber = -1;
+static barcode_event_t lastBarcodeEvent;
 
 /**
  * @brief SSI handler function.
@@ -33,11 +41,90 @@ static const char * const ssi_tags[] = {"code"};
 static u16_t ssi_handler(int iIndex, char *pcInsert, int iInsertLen)
 {
     size_t printed; // Variable to store the number of characters printed
+    threshold_levels_t levels, rightLevels; // Live threshold levels
+    odometry_pose_t pose; // Live odometry pose
+    safety_stats_t safety; // Emergency stops and their latencies
+    ultrasonic_event_t ranges[ULTRASONIC_MAX_SENSORS]; // Newest reading of every ultrasonic sensor
+    int sensors;
 
     switch (iIndex) {
     case 0:
-        // Handle the first SSI tag - output a character from the barcode
-        printed = snprintf(pcInsert, iInsertLen, "%c", getBarcodeChar());
+        // Handle the first SSI tag - output the newest barcode payload without blocking
+        while (barcode_get_event(barcodeSubscriber, &lastBarcodeEvent, 0)) {
+        }
+        printed = snprintf(pcInsert, iInsertLen, "%s", lastBarcodeEvent.payload);
+        break;
+
+    case 1:
+        // Handle the second SSI tag - output the barcode capture interrupts per second
+        printed = snprintf(pcInsert, iInsertLen, "%lu", (unsigned long)barcode_get_irq_rate());
+        break;
+
+    case 2:
+        // Handle the third SSI tag - output the worst-case barcode ISR time in microseconds
+        printed = snprintf(pcInsert, iInsertLen, "%lu", (unsigned long)barcode_get_isr_max_us());
+        break;
+
+    case 3:
+        // Handle the fourth SSI tag - output the barcode sensor's adaptive threshold
+        barcode_get_threshold_levels(&levels);
+        printed = snprintf(pcInsert, iInsertLen, "white %u, black %u, switch %u-%u",
+                           levels.white, levels.black, levels.low, levels.high);
+        break;
+
+    case 4:
+        // Handle the fifth SSI tag - output both IR line sensors' adaptive thresholds
+        getLeftIRLevels(&levels);
+        getRightIRLevels(&rightLevels);
+        printed = snprintf(pcInsert, iInsertLen, "left %u-%u, right %u-%u",
+                           levels.low, levels.high, rightLevels.low, rightLevels.high);
+        break;
+
+    case 5:
+        // Handle the sixth SSI tag - output the odometry pose in mm and degrees
+        odometry_get_pose(&pose);
+        printed = snprintf(pcInsert, iInsertLen, "x %ld mm, y %ld mm, heading %lu deg",
+                           (long)(pose.x / 1000), (long)(pose.y / 1000),
+                           (unsigned long)ODOMETRY_ANGLE_TO_DEGREES(pose.theta));
+        break;
+
+    case 6:
+        // Handle the seventh SSI tag - output the worst-case ultrasonic echo ISR time in microseconds
+        printed = snprintf(pcInsert, iInsertLen, "%lu", (unsigned long)ultrasonic_get_isr_max_us());
+        break;
+
+    case 7:
+        // Handle the eighth SSI tag - output the emergency stops and their latencies in microseconds
+        safety_get_stats(&safety);
+        printed = snprintf(pcInsert, iInsertLen, "%lu stops (%lu stale), last %lu us (echo %lu us), worst %lu us (echo %lu us)",
+                           (unsigned long)safety.stops, (unsigned long)safety.staleStops,
+                           (unsigned long)safety.lastLatencyUs, (unsigned long)safety.lastEchoLatencyUs,
+                           (unsigned long)safety.maxLatencyUs, (unsigned long)safety.maxEchoLatencyUs);
+        break;
+
+    case 8:
+        // Handle the ninth SSI tag - output every ultrasonic sensor's newest distance in mm
+        sensors = ultrasonic_get_range_table(ranges);
+        printed = 0;
+
+        for (int i = 0; i < sensors && (int)printed < iInsertLen; i++) {
+            if (ranges[i].valid) {
+                printed += snprintf(pcInsert + printed, iInsertLen - printed, "%s%d: %lu mm", i ? ", " : "",
+                                    i, (unsigned long)ranges[i].distance_mm);
+            }
+            else {
+                printed += snprintf(pcInsert + printed, iInsertLen - printed, "%s%d: clear", i ? ", " : "", i);
+            }
+        }
+
+        if ((int)printed >= iInsertLen) {
+            printed = iInsertLen - 1;
+        }
+        break;
+
+    case 9:
+        // Handle the tenth SSI tag - output the barcode capture blocks skipped because decoding fell behind
+        printed = snprintf(pcInsert, iInsertLen, "%lu", (unsigned long)barcode_get_dropped_blocks());
         break;
 
     default:
@@ -62,6 +149,9 @@ void ssi_init(void)
     // adc_set_temp_sensor_enabled(true);
     // adc_select_input(4);
 
+    // Receive barcode events for the barcode tag
+    barcodeSubscriber = barcode_subscribe();
+
     // Set the SSI handler with the defined tags
     http_set_ssi_handler(ssi_handler, ssi_tags, LWIP_ARRAYSIZE(ssi_tags));
 }
@@ -0,0 +1,333 @@
+/**
+ * @file barcode_isr_bench.c
+ *
+ * @brief Host-side harness timing the barcode ADC ISR before and after moving
+ *        the decode into the decode task.
+ *
+ * The previous ADC_IRQ_FIFO_HANDLER averaged the samples, classified each reading
+ * and, on every colour edge, pushed the finished bar element and decoded the
+ * latest window in the interrupt, printing each character it read. The current
+ * one averages, classifies and queues the edge for the decode task, which is then
+ * notified. Both are fed the same ADC sample stream (one interrupt per sample) of
+ * a Code 39 label read over and over, and decode it with the car's decoder
+ * (barcode_decoder.c), so the decoding work matches what either handler would do.
+ * The harness checks that both read the same payloads.
+ *
+ * Every interrupt is timed with the same clock. The stream is replayed several
+ * times and each interrupt keeps its fastest run, which removes host noise (other
+ * processes, cache misses from the first pass); the worst of those is the figure
+ * to compare with barcode_get_isr_max_us() on the car. The cost of timing an
+ * empty call is subtracted.
+ *
+ * Cycle counts come from the time stamp counter on x86 hosts, nanoseconds
+ * elsewhere. The printf of the previous handler is made into a buffer here; on
+ * the car it went out over stdio from the interrupt, so the previous figure is a
+ * lower bound.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Ihardware_barcode/include -Ihardware_threshold/include tools/barcode_isr_bench.c \
+ *         hardware_barcode/barcode_decoder.c hardware_barcode/code39.c \
+ *         hardware_threshold/threshold.c -o barcode_isr_bench
+ *     ./barcode_isr_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "hardware/barcode_decoder.h"
+#include "hardware/code39.h"
+#include "hardware/threshold.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles"
+static inline uint64_t benchClock(void) {
+    return __rdtsc();
+}
+#else
+#define BENCH_UNIT "ns"
+static inline uint64_t benchClock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+#define BENCH_LABEL "*AB12*"
+#define BENCH_PAYLOAD "AB12"
+#define BENCH_SCANS 8           // Times the label passes under the sensor
+#define BENCH_RUNS 9            // Replays of the whole stream; each interrupt keeps its fastest
+#define BENCH_DECIMATION 100    // Same as BARCODE_DECIMATION
+#define BENCH_SAMPLE_US 2       // Same as BARCODE_ADC_SAMPLE_US
+#define BENCH_NARROW 8          // Readings per narrow element
+#define BENCH_WIDE 20           // Readings per wide element
+#define BENCH_QUIET 60          // Readings of white before and after the label
+#define BENCH_WHITE 350
+#define BENCH_BLACK 1900
+#define BENCH_NOISE 120
+#define BENCH_EDGE_QUEUE_SIZE 32  // Same as BARCODE_EDGE_QUEUE_SIZE
+#define BENCH_EDGE_QUEUE_MASK (BENCH_EDGE_QUEUE_SIZE - 1)
+
+// Element patterns of the Code 39 characters, for building the label
+#define BENCH_PATTERN_ENTRY(character, e0, e1, e2, e3, e4, e5, e6, e7, e8) \
+    { character, CODE39_PATTERN(e0, e1, e2, e3, e4, e5, e6, e7, e8) },
+static const struct {
+    char character;
+    uint16_t pattern;
+} benchPatterns[] = {
+    CODE39_PATTERNS(BENCH_PATTERN_ENTRY)
+};
+
+static uint16_t *samples;
+static uint32_t sampleCount;
+static uint32_t sampleIndex;
+
+// Simulated ADC FIFO and clock the handlers see
+static inline uint16_t adcFifoGet(void) {
+    return samples[sampleIndex];
+}
+
+static inline uint32_t sampleTimeUs(void) {
+    return sampleIndex * BENCH_SAMPLE_US;
+}
+
+// Append count readings of one level, each BENCH_DECIMATION noisy samples
+static void appendReadings(uint32_t count, uint16_t level) {
+    for (uint32_t reading = 0; reading < count; reading++) {
+        for (int k = 0; k < BENCH_DECIMATION; k++) {
+            samples[sampleCount++] = level - BENCH_NOISE / 2 + rand() % BENCH_NOISE;
+        }
+    }
+}
+
+// Build the sample stream of the label read BENCH_SCANS times
+static void buildStream(void) {
+    uint32_t perScan = 2 * BENCH_QUIET + strlen(BENCH_LABEL) * (CODE39_ELEMENTS + 1) * BENCH_WIDE;
+    samples = malloc((size_t)perScan * BENCH_SCANS * BENCH_DECIMATION * sizeof(uint16_t));
+
+    for (int scan = 0; scan < BENCH_SCANS; scan++) {
+        appendReadings(BENCH_QUIET, BENCH_WHITE);
+
+        for (const char *c = BENCH_LABEL; *c != 0; c++) {
+            uint16_t pattern = 0;
+
+            for (size_t p = 0; p < sizeof(benchPatterns) / sizeof(benchPatterns[0]); p++) {
+                if (benchPatterns[p].character == *c) {
+                    pattern = benchPatterns[p].pattern;
+                }
+            }
+
+            for (int element = 0; element < CODE39_ELEMENTS; element++) {
+                int wide = (pattern >> (CODE39_ELEMENTS - 1 - element)) & 1;
+                appendReadings(wide ? BENCH_WIDE : BENCH_NARROW, element % 2 == 0 ? BENCH_BLACK : BENCH_WHITE);
+            }
+
+            // Narrow gap between characters
+            appendReadings(BENCH_NARROW, BENCH_WHITE);
+        }
+
+        appendReadings(BENCH_QUIET, BENCH_WHITE);
+    }
+}
+
+// Previous handler state and body: decodes in the interrupt
+static uint32_t legacySum = 0;
+static int legacyCount = 0;
+static threshold_t legacyThreshold;
+static barcode_decoder_t legacyDecoder;
+static int legacyColour = -1;
+static char legacyOutput[64];
+static uint32_t legacyPayloads = 0;
+
+static void legacyAdcHandler(void) {
+    legacySum += adcFifoGet();
+
+    if (legacyCount < BENCH_DECIMATION) {
+        legacyCount++;
+        return;
+    }
+
+    uint16_t avg = legacySum / legacyCount;
+    legacyCount = 0;
+    legacySum = 0;
+
+    int colour = barcode_classify(&legacyThreshold, avg, 0);
+
+    if (colour == legacyColour) {
+        return;
+    }
+
+    legacyColour = colour;
+
+    int decoded = barcode_decoder_edge(&legacyDecoder, colour, sampleTimeUs());
+
+    if (decoded & BARCODE_DECODED_CHARACTER) {
+        snprintf(legacyOutput, sizeof(legacyOutput), "%c", legacyDecoder.lastCharacter);
+    }
+    if ((decoded & BARCODE_DECODED_PAYLOAD) && strcmp(legacyDecoder.lastPayload, BENCH_PAYLOAD) == 0) {
+        legacyPayloads++;
+    }
+}
+
+// Current handler state and body: queues the edge for the decode task
+struct benchEdge {
+    uint8_t colour;
+    uint32_t time;
+};
+
+static uint32_t currentSum = 0;
+static int currentCount = 0;
+static threshold_t currentThreshold;
+static int currentColour = -1;
+static struct benchEdge edgeQueue[BENCH_EDGE_QUEUE_SIZE];
+static volatile uint32_t edgeHead = 0;
+static volatile uint32_t edgeTail = 0;
+static volatile uint32_t edgeOverflows = 0;
+static volatile uint32_t notifications = 0;
+
+static void currentAdcHandler(void) {
+    currentSum += adcFifoGet();
+
+    if (currentCount < BENCH_DECIMATION) {
+        currentCount++;
+        return;
+    }
+
+    uint16_t avg = currentSum / currentCount;
+    currentCount = 0;
+    currentSum = 0;
+
+    int colour = barcode_classify(&currentThreshold, avg, 0);
+
+    if (colour == currentColour) {
+        return;
+    }
+
+    currentColour = colour;
+
+    if (edgeHead - edgeTail >= BENCH_EDGE_QUEUE_SIZE) {
+        edgeOverflows++;
+        return;
+    }
+
+    struct benchEdge *edge = &edgeQueue[edgeHead & BENCH_EDGE_QUEUE_MASK];
+    edge->colour = colour;
+    edge->time = sampleTimeUs();
+
+    __asm__ volatile ("" : : : "memory");
+    edgeHead++;
+
+    // Stands in for vTaskNotifyGiveFromISR
+    notifications++;
+}
+
+// Decode task side of the current handler, run between interrupts and not timed
+static barcode_decoder_t taskDecoder;
+static uint32_t taskPayloads = 0;
+
+static void drainEdges(void) {
+    while (edgeTail != edgeHead) {
+        struct benchEdge edge = edgeQueue[edgeTail & BENCH_EDGE_QUEUE_MASK];
+        edgeTail++;
+
+        int decoded = barcode_decoder_edge(&taskDecoder, edge.colour, edge.time);
+
+        if ((decoded & BARCODE_DECODED_PAYLOAD) && strcmp(taskDecoder.lastPayload, BENCH_PAYLOAD) == 0) {
+            taskPayloads++;
+        }
+    }
+}
+
+static void emptyHandler(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+// Time every interrupt of one replay, keeping each interrupt's fastest run
+static void timeRun(void (*handler)(void), int drain, uint64_t *fastest) {
+    for (sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++) {
+        uint64_t start = benchClock();
+        handler();
+        uint64_t elapsed = benchClock() - start;
+
+        if (elapsed < fastest[sampleIndex]) {
+            fastest[sampleIndex] = elapsed;
+        }
+        if (drain) {
+            drainEdges();
+        }
+    }
+}
+
+static void resetState(void) {
+    legacySum = currentSum = 0;
+    legacyCount = currentCount = 0;
+    legacyColour = currentColour = -1;
+    threshold_init(&legacyThreshold, BARCODE_WHITE_LEVEL, BARCODE_BLACK_LEVEL, BARCODE_THRESHOLD_DECAY_SHIFT);
+    threshold_init(&currentThreshold, BARCODE_WHITE_LEVEL, BARCODE_BLACK_LEVEL, BARCODE_THRESHOLD_DECAY_SHIFT);
+    barcode_decoder_init(&legacyDecoder);
+    barcode_decoder_init(&taskDecoder);
+    edgeHead = edgeTail = 0;
+}
+
+// Report the worst and mean of the per-interrupt fastest times, less the overhead
+static void report(const char *name, const uint64_t *fastest, double overhead) {
+    double worst = 0, total = 0;
+
+    for (uint32_t k = 0; k < sampleCount; k++) {
+        double elapsed = (double)fastest[k] - overhead;
+
+        if (elapsed < 0) {
+            elapsed = 0;
+        }
+        if (elapsed > worst) {
+            worst = elapsed;
+        }
+        total += elapsed;
+    }
+
+    printf("%-15s worst %7.1f %s, mean %5.1f %s per interrupt\n", name, worst, BENCH_UNIT,
+           total / sampleCount, BENCH_UNIT);
+}
+
+int main(void) {
+    srand(39);
+    buildStream();
+
+    uint64_t *emptyFastest = malloc(sampleCount * sizeof(uint64_t));
+    uint64_t *legacyFastest = malloc(sampleCount * sizeof(uint64_t));
+    uint64_t *currentFastest = malloc(sampleCount * sizeof(uint64_t));
+
+    for (uint32_t k = 0; k < sampleCount; k++) {
+        emptyFastest[k] = legacyFastest[k] = currentFastest[k] = UINT64_MAX;
+    }
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        resetState();
+        legacyPayloads = taskPayloads = 0;
+        timeRun(emptyHandler, 0, emptyFastest);
+        timeRun(legacyAdcHandler, 0, legacyFastest);
+        timeRun(currentAdcHandler, 1, currentFastest);
+    }
+
+    // The cheapest empty call is what timing itself costs
+    double overhead = (double)UINT64_MAX;
+    for (uint32_t k = 0; k < sampleCount; k++) {
+        if (emptyFastest[k] < overhead) {
+            overhead = (double)emptyFastest[k];
+        }
+    }
+
+    printf("interrupts:     %lu per run, %d runs\n", (unsigned long)sampleCount, BENCH_RUNS);
+    report("previous ISR:", legacyFastest, overhead);
+    report("current ISR:", currentFastest, overhead);
+    printf("payloads:       %lu previous, %lu current (of %d scans)\n", (unsigned long)legacyPayloads,
+           (unsigned long)taskPayloads, BENCH_SCANS);
+    printf("overflows:      %lu\n", (unsigned long)edgeOverflows);
+
+    return legacyPayloads != BENCH_SCANS || taskPayloads != BENCH_SCANS || edgeOverflows != 0;
+}
+
+/*** End of file ***/
@@ -0,0 +1,303 @@
+/**
+ * @file barcode_replay.c
+ *
+ * @brief Host-side replay of recorded barcode traces through the car's decoder.
+ *
+ * Build the firmware with BARCODE_TRACE_ENABLED=1 and the car prints every full
+ * trace of ADC readings over stdio (see hardware/barcode_trace.h). Each trace is
+ * pushed through the same adaptive threshold, edge-to-element and Code 39 payload
+ * code the car runs (barcode_decoder.c), as fast as the host allows.
+ *
+ * Each argument is a trace file, optionally followed by "=" and the payload the
+ * trace should decode to. A file is either a raw binary trace or a serial log
+ * holding any number of hex-framed traces. For the whole corpus the tool reports:
+ *   - decode rate: traces with an expected payload that decoded it
+ *   - misreads: payloads that differ from the expected one
+ *   - latency per character: trace time from the leading edge of a character's
+ *     first bar to the reading that decoded it
+ *   - replay speed relative to real time
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Ihardware_barcode/include -Ihardware_threshold/include tools/barcode_replay.c \
+ *         hardware_barcode/barcode_decoder.c hardware_barcode/code39.c \
+ *         hardware_threshold/threshold.c -o barcode_replay
+ *     ./barcode_replay car.log=AB12 reverse.log=AB12 noise.bctr
+ *
+ * The decoder is compiled with the host's BARCODE_CHECKSUM_ENABLED, so pass
+ * -DBARCODE_CHECKSUM_ENABLED=1 when the car was built with it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "hardware/barcode_decoder.h"
+#include "hardware/barcode_trace.h"
+#include "hardware/threshold.h"
+
+#define REPLAY_EDGE_HISTORY 16  // Edge times kept to measure character latency, above BARCODE_ARR_SIZE
+#define REPLAY_DOMAIN_DISTANCE 1 // Matches BARCODE_WIDTH_DISTANCE in barcode.h
+
+// Results over the whole corpus
+struct replayStats {
+    uint32_t traces;
+    uint32_t expectedTraces;    // Traces given an expected payload
+    uint32_t decodedTraces;     // ... of which decoded it at least once
+    uint32_t payloads;
+    uint32_t misreads;
+    uint32_t characters;
+    uint64_t latencyTotalUs;
+    uint64_t latencyMaxUs;
+    uint64_t readings;
+    uint64_t traceUs;
+    uint32_t checksumFailures;
+};
+
+static uint16_t getField(const uint8_t *field) {
+    return field[0] | (field[1] << 8);
+}
+
+static uint32_t getWord(const uint8_t *field) {
+    return getField(field) | ((uint32_t)getField(field + 2) << 16);
+}
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Replay one binary trace and add its results to stats
+static void replayTrace(const char *name, const uint8_t *data, size_t size, const char *expected,
+                        struct replayStats *stats) {
+    if (size < BARCODE_TRACE_HEADER_SIZE || memcmp(data, BARCODE_TRACE_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s: not a barcode trace\n", name);
+        return;
+    }
+
+    uint8_t version = data[4];
+    uint8_t domain = data[5];
+    uint16_t recordSize = getField(&data[6]);
+    uint32_t records = getWord(&data[8]);
+
+    if (version != BARCODE_TRACE_VERSION || recordSize < BARCODE_TRACE_TIME_RECORD_SIZE ||
+        (domain == REPLAY_DOMAIN_DISTANCE && recordSize < BARCODE_TRACE_DISTANCE_RECORD_SIZE)) {
+        fprintf(stderr, "%s: unsupported trace (version %u, record size %u)\n", name, version, recordSize);
+        return;
+    }
+
+    if ((size - BARCODE_TRACE_HEADER_SIZE) / recordSize < records) {
+        fprintf(stderr, "%s: truncated, %u of %u records\n", name,
+                (unsigned)((size - BARCODE_TRACE_HEADER_SIZE) / recordSize), records);
+        records = (size - BARCODE_TRACE_HEADER_SIZE) / recordSize;
+    }
+
+    threshold_t threshold;
+    barcode_decoder_t decoder;
+    threshold_init(&threshold, BARCODE_WHITE_LEVEL, BARCODE_BLACK_LEVEL, BARCODE_THRESHOLD_DECAY_SHIFT);
+    barcode_decoder_init(&decoder);
+
+    uint64_t edgeTimes[REPLAY_EDGE_HISTORY];
+    uint32_t edges = 0;
+    int colour = -1;
+    uint64_t timeUs = 0;
+    uint32_t stamp = 0;
+    int found = 0;
+
+    for (uint32_t r = 0; r < records; r++) {
+        const uint8_t *record = &data[BARCODE_TRACE_HEADER_SIZE + (size_t)r * recordSize];
+        uint16_t reading = getField(record);
+        uint16_t deltaUs = getField(record + 2);
+
+        timeUs += deltaUs;
+        stamp += domain == REPLAY_DOMAIN_DISTANCE ? getField(record + 4) : deltaUs;
+
+        int next = barcode_classify(&threshold, reading & BARCODE_TRACE_READING_MASK,
+                                    (reading & BARCODE_TRACE_DIGITAL_BIT) != 0);
+
+        if (next == colour) {
+            continue;
+        }
+
+        colour = next;
+        edgeTimes[edges % REPLAY_EDGE_HISTORY] = timeUs;
+        edges++;
+
+        int decoded = barcode_decoder_edge(&decoder, colour, stamp);
+
+        if ((decoded & BARCODE_DECODED_CHARACTER) && edges > BARCODE_ARR_SIZE) {
+            // This edge ended the character's last bar; its first bar began 9 edges earlier
+            uint64_t latency = timeUs - edgeTimes[(edges - 1 - BARCODE_ARR_SIZE) % REPLAY_EDGE_HISTORY];
+            stats->characters++;
+            stats->latencyTotalUs += latency;
+
+            if (latency > stats->latencyMaxUs) {
+                stats->latencyMaxUs = latency;
+            }
+        }
+
+        if (decoded & BARCODE_DECODED_PAYLOAD) {
+            int correct = expected == NULL || strcmp(decoder.lastPayload, expected) == 0;
+
+            printf("%s: %.3f s \"%s\" confidence %u%s\n", name, timeUs / 1e6, decoder.lastPayload,
+                   decoder.lastPayloadConfidence, correct ? "" : " MISREAD");
+            stats->payloads++;
+            stats->misreads += !correct;
+            found |= expected != NULL && correct;
+        }
+    }
+
+    if (expected != NULL && !found) {
+        printf("%s: expected \"%s\" not decoded\n", name, expected);
+    }
+
+    stats->traces++;
+    stats->expectedTraces += expected != NULL;
+    stats->decodedTraces += found;
+    stats->readings += records;
+    stats->traceUs += timeUs;
+    stats->checksumFailures += decoder.checksumFailures;
+}
+
+// Replay every hex-framed trace in a serial log
+static void replayLog(const char *name, const char *text, const char *expected, struct replayStats *stats) {
+    uint8_t *trace = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    int inside = 0;
+
+    while (*text) {
+        const char *end = strchr(text, '\n');
+        size_t lineLength = end ? (size_t)(end - text) : strlen(text);
+
+        while (lineLength > 0 && isspace((unsigned char)text[lineLength - 1])) {
+            lineLength--;
+        }
+
+        if (lineLength == strlen(BARCODE_TRACE_BEGIN) && memcmp(text, BARCODE_TRACE_BEGIN, lineLength) == 0) {
+            inside = 1;
+            length = 0;
+        }
+        else if (inside && lineLength == strlen(BARCODE_TRACE_END) && memcmp(text, BARCODE_TRACE_END, lineLength) == 0) {
+            inside = 0;
+            replayTrace(name, trace, length, expected, stats);
+        }
+        else if (inside) {
+            // Skip anything else another task printed in between
+            size_t k = 0;
+
+            while (k < lineLength && isxdigit((unsigned char)text[k])) {
+                k++;
+            }
+
+            if (k == lineLength && lineLength % 2 == 0) {
+                if (length + lineLength / 2 > capacity) {
+                    capacity = (length + lineLength / 2) * 2;
+                    trace = realloc(trace, capacity);
+                }
+
+                for (k = 0; k < lineLength; k += 2) {
+                    char byte[3] = {text[k], text[k + 1], 0};
+                    trace[length++] = (uint8_t)strtoul(byte, NULL, 16);
+                }
+            }
+        }
+
+        text = end ? end + 1 : text + strlen(text);
+    }
+
+    free(trace);
+}
+
+// Read a whole file into memory, with a terminating 0 for text parsing
+static uint8_t *readFile(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t capacity = 1 << 16;
+    uint8_t *data = malloc(capacity);
+    *size = 0;
+
+    size_t got;
+    while ((got = fread(data + *size, 1, capacity - *size - 1, file)) > 0) {
+        *size += got;
+
+        if (*size + 1 == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+    }
+
+    fclose(file);
+    data[*size] = 0;
+
+    return data;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace[=EXPECTED] ...\n", argv[0]);
+        return 2;
+    }
+
+    struct replayStats stats = {0};
+    double start = nowNs();
+
+    for (int a = 1; a < argc; a++) {
+        char *path = argv[a];
+        char *expected = strchr(path, '=');
+
+        if (expected != NULL) {
+            *expected++ = '\0';
+        }
+
+        size_t size;
+        uint8_t *data = readFile(path, &size);
+
+        if (data == NULL) {
+            fprintf(stderr, "%s: cannot read\n", path);
+            continue;
+        }
+
+        if (size >= 4 && memcmp(data, BARCODE_TRACE_MAGIC, 4) == 0) {
+            replayTrace(path, data, size, expected, &stats);
+        }
+        else {
+            replayLog(path, (const char *)data, expected, &stats);
+        }
+
+        free(data);
+    }
+
+    double hostNs = nowNs() - start;
+
+    printf("\ntraces:         %u (%.1f s of readings, %llu readings)\n", stats.traces,
+           stats.traceUs / 1e6, (unsigned long long)stats.readings);
+    printf("payloads:       %u (%u misread, %u failed checksum)\n", stats.payloads, stats.misreads,
+           stats.checksumFailures);
+
+    if (stats.expectedTraces != 0) {
+        printf("decode rate:    %u/%u (%.1f%%)\n", stats.decodedTraces, stats.expectedTraces,
+               100.0 * stats.decodedTraces / stats.expectedTraces);
+    }
+
+    if (stats.characters != 0) {
+        printf("char latency:   %.0f us mean, %llu us max over %u characters\n",
+               (double)stats.latencyTotalUs / stats.characters, (unsigned long long)stats.latencyMaxUs,
+               stats.characters);
+    }
+
+    if (hostNs > 0) {
+        printf("replay speed:   %.0fx real time\n", stats.traceUs * 1e3 / hostNs);
+    }
+
+    return stats.misreads != 0 || stats.decodedTraces != stats.expectedTraces;
+}
+
+/*** End of file ***/
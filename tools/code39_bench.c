@@ -0,0 +1,197 @@
+/**
+ * @file code39_bench.c
+ *
+ * @brief Host-side benchmark of the table-driven Code 39 decoder.
+ *
+ * Compares code39_decode() against the previous decoder, which built a malloc'd
+ * thick/thin string for every attempt and scanned it with up to 27 strncmp calls.
+ * Both decoders are fed the same set of element widths (valid characters with
+ * jitter plus random noise); the benchmark checks that they agree on the characters
+ * the previous decoder knew and reports the average time per decode.
+ *
+ * It then stretches or shrinks one element of every valid character, as a misread
+ * bar would, and compares how many characters the exact lookup and the
+ * nearest-match decoder (code39_match_window) still recover.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Ihardware_barcode/include tools/code39_bench.c hardware_barcode/code39.c -o code39_bench
+ *     ./code39_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "hardware/code39.h"
+
+#define BENCH_SAMPLES 4096
+#define BENCH_ROUNDS 200
+#define BENCH_NARROW 40
+#define BENCH_WIDE 100
+#define BENCH_JITTER 12
+
+// Thick/thin strings used by the previous decoder (0/2 = thick, 1/3 = thin).
+static const char *legacyMaps[] = {
+    "031312130", "130312130", "030312131", "131302130", "031302131", "130302131",
+    "131312030", "031312031", "130312031", "131302031", "031313120", "130313120",
+    "030313121", "131303120", "031303121", "130303121", "131313020", "031313021",
+    "130313021", "131303021", "021313130", "120313130", "020313131", "121303130",
+    "021303131", "120303131", "121303031"
+};
+static const char legacyCharacters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ*";
+
+// Previous decoder: mean split, malloc'd strings and a strncmp scan.
+static char legacyDecode(const uint32_t widths[CODE39_ELEMENTS]) {
+    int64_t total = 0;
+    for (int i = 0; i < CODE39_ELEMENTS; i++) {
+        total += widths[i];
+    }
+    int64_t avg = total / CODE39_ELEMENTS;
+
+    int *barsRead = malloc(CODE39_ELEMENTS * sizeof(int));
+    for (int i = 0; i < CODE39_ELEMENTS; i++) {
+        int black = (i % 2) == 0;
+        if (black) {
+            barsRead[i] = widths[i] < avg ? 1 : 0;
+        }
+        else {
+            barsRead[i] = widths[i] < avg ? 3 : 2;
+        }
+    }
+
+    char *string = malloc(CODE39_ELEMENTS + 1);
+    for (int i = 0; i < CODE39_ELEMENTS; i++) {
+        string[i] = barsRead[i] + '0';
+    }
+    string[CODE39_ELEMENTS] = '\0';
+    free(barsRead);
+
+    char read = 0;
+    for (int i = 0; i < 27; i++) {
+        if (strncmp(legacyMaps[i], string, CODE39_ELEMENTS) == 0) {
+            read = legacyCharacters[i];
+            break;
+        }
+    }
+
+    free(string);
+    return read;
+}
+
+static uint32_t jitter(uint32_t width) {
+    return width - BENCH_JITTER + (uint32_t)(rand() % (2 * BENCH_JITTER + 1));
+}
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void) {
+    static uint32_t samples[BENCH_SAMPLES][CODE39_ELEMENTS];
+    srand(39);
+
+    // Three quarters valid characters, one quarter random noise.
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        if (s % 4 != 3) {
+            const char *map = legacyMaps[rand() % 27];
+            for (int i = 0; i < CODE39_ELEMENTS; i++) {
+                int wide = map[i] == '0' || map[i] == '2';
+                samples[s][i] = jitter(wide ? BENCH_WIDE : BENCH_NARROW);
+            }
+        }
+        else {
+            for (int i = 0; i < CODE39_ELEMENTS; i++) {
+                samples[s][i] = 1 + rand() % (2 * BENCH_WIDE);
+            }
+        }
+    }
+
+    int mismatches = 0;
+    int decoded = 0;
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        char expected = legacyDecode(samples[s]);
+        char actual = code39_decode(samples[s]);
+        // The previous decoder only knew A-Z and '*'; characters added since
+        // (digits and symbols) are only mismatches if it decoded something else.
+        if (expected != 0 || strchr(legacyCharacters, actual) != NULL) {
+            mismatches += expected != actual;
+        }
+        decoded += actual != 0;
+    }
+
+    volatile char sink = 0;
+
+    double start = nowNs();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int s = 0; s < BENCH_SAMPLES; s++) {
+            sink ^= legacyDecode(samples[s]);
+        }
+    }
+    double legacyNs = (nowNs() - start) / ((double)BENCH_ROUNDS * BENCH_SAMPLES);
+
+    start = nowNs();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int s = 0; s < BENCH_SAMPLES; s++) {
+            sink ^= code39_decode(samples[s]);
+        }
+    }
+    double tableNs = (nowNs() - start) / ((double)BENCH_ROUNDS * BENCH_SAMPLES);
+
+    printf("samples:        %d (%d decoded)\n", BENCH_SAMPLES, decoded);
+    printf("mismatches:     %d\n", mismatches);
+    printf("strncmp scan:   %.1f ns/decode\n", legacyNs);
+    printf("table lookup:   %.1f ns/decode\n", tableNs);
+    printf("speedup:        %.1fx\n", legacyNs / tableNs);
+
+    // One misread element per character
+    int expectedCount = 0;
+    int lookupRecovered = 0;
+    int matchRecovered = 0;
+    int matchWrong = 0;
+    static uint32_t damaged[BENCH_SAMPLES][CODE39_ELEMENTS];
+    static char expectedChars[BENCH_SAMPLES];
+
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        int index = rand() % 27;
+        const char *map = legacyMaps[index];
+        for (int i = 0; i < CODE39_ELEMENTS; i++) {
+            int wide = map[i] == '0' || map[i] == '2';
+            damaged[s][i] = jitter(wide ? BENCH_WIDE : BENCH_NARROW);
+        }
+        int bad = rand() % CODE39_ELEMENTS;
+        damaged[s][bad] = (rand() % 2) ? damaged[s][bad] * 9 / 5 : damaged[s][bad] * 11 / 20;
+        expectedChars[s] = legacyCharacters[index];
+    }
+
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        code39_match_t match;
+        code39_match_window(damaged[s], 0, UINT32_MAX, 0, &match);
+        expectedCount++;
+        lookupRecovered += code39_decode(damaged[s]) == expectedChars[s];
+        matchRecovered += match.character == expectedChars[s];
+        matchWrong += match.character != 0 && match.character != expectedChars[s];
+    }
+
+    start = nowNs();
+    for (int r = 0; r < BENCH_ROUNDS / 10; r++) {
+        for (int s = 0; s < BENCH_SAMPLES; s++) {
+            code39_match_t match;
+            code39_match_window(damaged[s], 0, UINT32_MAX, 0, &match);
+            sink ^= match.character;
+        }
+    }
+    double matchNs = (nowNs() - start) / ((double)(BENCH_ROUNDS / 10) * BENCH_SAMPLES);
+
+    printf("\none misread element per character:\n");
+    printf("lookup:         %d/%d recovered\n", lookupRecovered, expectedCount);
+    printf("nearest match:  %d/%d recovered, %d wrong\n", matchRecovered, expectedCount, matchWrong);
+    printf("nearest match:  %.1f ns/decode\n", matchNs);
+
+    return mismatches != 0;
+}
+
+/*** End of file ***/
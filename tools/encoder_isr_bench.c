@@ -0,0 +1,218 @@
+/**
+ * @file encoder_isr_bench.c
+ *
+ * @brief Host-side harness timing the wheel encoder ISR before and after moving
+ *        distance and speed out of the interrupt.
+ *
+ * The previous leftEncoder() converted both notch counts to double, multiplied
+ * them by CM_PER_NOTCH on every edge and, every NOTCHES_PER_CYCLE edges, did a
+ * double multiply and divide for the speed. The current one (built here from
+ * hardware_encoder/encoder.c) stores one timestamp and the count. Both are fed the
+ * same edge stream from a simulated clock. Every call is timed on its own, between
+ * fenced clock reads so the host CPU cannot overlap it with the loop around it,
+ * and the cost of timing an empty call is subtracted (clamped at 0). Calls that
+ * took over BENCH_OUTLIER times the median were hit by host noise (an interrupt,
+ * a context switch) and are left out of the mean. The harness also checks that getLeftSpeed() matches the speed the previous ISR
+ * computed, and times encoder_get_snapshot(), which the control loop calls at
+ * up to 1 kHz.
+ *
+ * Cycle counts come from the time stamp counter on x86 hosts, nanoseconds
+ * elsewhere. A desktop CPU does doubles in hardware, so the gap shown here is a
+ * lower bound: on the RP2040 (no FPU) every double operation in the previous ISR
+ * was a soft-float library call of tens of cycles or more.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Itools/host -Ihardware_encoder/include tools/encoder_isr_bench.c \
+ *         hardware_encoder/encoder.c -o encoder_isr_bench
+ *     ./encoder_isr_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "hardware/encoder.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles"
+static inline uint64_t benchClock(void) {
+    _mm_lfence();
+    uint64_t now = __rdtsc();
+    _mm_lfence();
+    return now;
+}
+#else
+#define BENCH_UNIT "ns"
+static inline uint64_t benchClock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+#define BENCH_EDGES 1000000
+#define BENCH_OUTLIER 20        // Calls over this many times the median count as host noise
+#define BENCH_PERIOD_US 2500    // 400 cm/s with 1 cm notches
+
+// Simulated time the firmware sees
+static volatile uint64_t fakeTimeUs = 0;
+
+uint64_t time_us_64(void) {
+    return fakeTimeUs;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)fakeTimeUs;
+}
+
+// Previous ISR state and body, kept for comparison
+static volatile uint32_t legacyNotchCount = 0;
+static volatile uint32_t legacyTempNotchCount = 0;
+static volatile double legacyTotalDistance = 0.0;
+static volatile double legacyTempTotalDistance = 0.0;
+static volatile uint64_t legacyLastNotchTime = 0;
+static volatile double legacyEncoderSpeed = 0.0;
+static volatile uint64_t legacyLastEdgeTime = 0;
+static volatile uint64_t legacyPrevEdgeTime = 0;
+
+static void legacyLeftEncoder(void) {
+    legacyPrevEdgeTime = legacyLastEdgeTime;
+    legacyLastEdgeTime = time_us_64();
+
+    legacyNotchCount++;
+    legacyTempNotchCount++;
+
+    legacyTotalDistance = (double)legacyNotchCount * CM_PER_NOTCH;
+    legacyTempTotalDistance = (double)legacyTempNotchCount * CM_PER_NOTCH;
+
+    if (legacyTempNotchCount % NOTCHES_PER_CYCLE == 0) {
+        uint64_t currentTime = time_us_64();
+        uint64_t timeDiff = currentTime - legacyLastNotchTime;
+
+        if (timeDiff > 0) {
+            legacyEncoderSpeed = legacyTempTotalDistance * 1e6 / timeDiff;
+        }
+
+        legacyLastNotchTime = currentTime;
+        legacyTempNotchCount = 0;
+    }
+}
+
+// Advance the simulated clock to the next edge, with a little jitter so the speed
+// is not the same every cycle
+static inline void nextEdgeTime(uint32_t edge) {
+    fakeTimeUs += BENCH_PERIOD_US - 50 + (edge * 37) % 101;
+}
+
+// Per-call costs of one version, in clock units, and a sorted copy for the median
+static int64_t costs[BENCH_EDGES];
+static int64_t sorted[BENCH_EDGES];
+
+static int compareCosts(const void *a, const void *b) {
+    int64_t left = *(const int64_t *)a;
+    int64_t right = *(const int64_t *)b;
+    return (left > right) - (left < right);
+}
+
+static void emptyHandler(void *params) {
+    (void)params;
+    __asm__ volatile ("" : : : "memory");
+}
+
+static void legacyHandler(void *params) {
+    (void)params;
+    legacyLeftEncoder();
+}
+
+// Time every call of handler over the edge stream, starting the clock from 0
+static void timeCalls(void (*handler)(void *)) {
+    fakeTimeUs = 0;
+    for (uint32_t edge = 1; edge <= BENCH_EDGES; edge++) {
+        nextEdgeTime(edge);
+        uint64_t start = benchClock();
+        handler(NULL);
+        costs[edge - 1] = (int64_t)(benchClock() - start);
+    }
+}
+
+// Mean cost per call less the timing overhead, leaving out host noise
+static double meanCost(int64_t overhead, uint32_t *outliers) {
+    memcpy(sorted, costs, sizeof(sorted));
+    qsort(sorted, BENCH_EDGES, sizeof(sorted[0]), compareCosts);
+
+    int64_t limit = sorted[BENCH_EDGES / 2] * BENCH_OUTLIER;
+    double total = 0;
+    uint32_t counted = 0;
+
+    for (uint32_t k = 0; k < BENCH_EDGES; k++) {
+        if (costs[k] > limit) {
+            continue;
+        }
+
+        int64_t cost = costs[k] - overhead;
+        total += cost > 0 ? cost : 0;
+        counted++;
+    }
+
+    *outliers = BENCH_EDGES - counted;
+    return total / counted;
+}
+
+int main(void) {
+    // Timing overhead: the cheapest empty call
+    timeCalls(emptyHandler);
+    int64_t overhead = costs[0];
+    for (uint32_t k = 1; k < BENCH_EDGES; k++) {
+        if (costs[k] < overhead) {
+            overhead = costs[k];
+        }
+    }
+
+    uint32_t legacyOutliers;
+    uint32_t currentOutliers;
+
+    timeCalls(legacyHandler);
+    double legacyCost = meanCost(overhead, &legacyOutliers);
+
+    timeCalls(leftEncoder);
+    double currentCost = meanCost(overhead, &currentOutliers);
+    uint64_t start;
+
+    // Both ISRs have now seen the same stream; their speeds must agree
+    double speed = getLeftSpeed(NULL);
+    int mismatch = fabs(speed - legacyEncoderSpeed) > 0.001 * legacyEncoderSpeed;
+
+    volatile double sink = 0;
+    start = benchClock();
+    for (uint32_t k = 0; k < BENCH_EDGES / 10; k++) {
+        sink += getLeftSpeed(NULL);
+    }
+    double speedCost = (double)(benchClock() - start) / (BENCH_EDGES / 10);
+
+    encoder_snapshot_t snapshot;
+    start = benchClock();
+    for (uint32_t k = 0; k < BENCH_EDGES / 10; k++) {
+        encoder_get_snapshot(&snapshot);
+    }
+    double snapshotCost = (double)(benchClock() - start) / (BENCH_EDGES / 10);
+    mismatch |= snapshot.left.speed != getLeftSpeedFixed(NULL) || snapshot.left.count != BENCH_EDGES;
+
+    printf("edges:          %d\n", BENCH_EDGES);
+    printf("timing cost:    %lld %s per call, subtracted\n", (long long)overhead, BENCH_UNIT);
+    printf("previous ISR:   %.1f %s per edge (double maths, %lu noisy calls left out)\n", legacyCost, BENCH_UNIT,
+           (unsigned long)legacyOutliers);
+    printf("current ISR:    %.1f %s per edge (count and timestamp only, %lu noisy calls left out)\n", currentCost,
+           BENCH_UNIT, (unsigned long)currentOutliers);
+    printf("getLeftSpeed:   %.1f %s per call (fixed point, task context)\n", speedCost, BENCH_UNIT);
+    printf("snapshot:       %.1f %s per call (both wheels)\n", snapshotCost, BENCH_UNIT);
+    printf("speed:          %.2f cm/s (previous ISR %.2f cm/s)\n", speed, legacyEncoderSpeed);
+
+    return mismatch;
+}
+
+/*** End of file ***/
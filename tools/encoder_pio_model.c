@@ -0,0 +1,380 @@
+/**
+ * @file encoder_pio_model.c
+ *
+ * @brief Host-side model of the encoder edge-timestamping PIO program.
+ *
+ * Reads hardware_encoder/encoder.pio, assembles the few instructions it uses
+ * (jmp with x-- or pin conditions, in x and side delays) and runs them cycle by
+ * cycle against a simulated encoder waveform, the way one RP2040 state machine
+ * would with the jmp pin on the encoder and autopush at 32 bits. Each pushed
+ * word is stored in a ring like the DMA channel does. The model checks that:
+ *   - every edge, rising or falling, pushes exactly one word
+ *   - the pushed time (~X) is within 1 us of the edge
+ *   - X drops by one exactly every 4 cycles on every path through the program
+ *   - starting at "low" or "high" to match the pin pushes nothing
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -Ihardware_encoder/include tools/encoder_pio_model.c -o encoder_pio_model
+ *     ./encoder_pio_model hardware_encoder/encoder.pio
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "hardware/encoder.h"
+
+#define MODEL_MAX_INSTRUCTIONS 32       // One PIO instruction memory
+#define MODEL_MAX_LABELS 32
+#define MODEL_CYCLES_PER_TICK 4         // Cycles per X decrement the firmware relies on
+#define MODEL_CYCLES_PER_US (ENCODER_PIO_HZ / 1000000)
+#define MODEL_EDGES 20000
+#define MODEL_MIN_GAP_CYCLES (2 * MODEL_CYCLES_PER_TICK)  // Shortest pulse the wheel could give, with margin
+
+enum modelOp {
+    OP_JMP,
+    OP_IN_X
+};
+
+enum modelCondition {
+    COND_ALWAYS,
+    COND_X_DEC,     // x--: jump if X was non-zero, then decrement
+    COND_PIN
+};
+
+struct modelInstruction {
+    enum modelOp op;
+    enum modelCondition condition;
+    char target[32];
+    int address;
+    int delay;
+    int line;
+};
+
+struct modelProgram {
+    struct modelInstruction code[MODEL_MAX_INSTRUCTIONS];
+    int length;
+    char labels[MODEL_MAX_LABELS][32];
+    int labelAddress[MODEL_MAX_LABELS];
+    int labelPublic[MODEL_MAX_LABELS];
+    int labelCount;
+};
+
+// Result of running the program over one waveform
+struct modelRun {
+    uint32_t pushes;
+    uint32_t missed;            // Edges that did not push exactly once
+    uint32_t maxErrorQuarterUs; // Worst |pushed time - edge time|, in cycles (1/4 us)
+    uint32_t badTicks;          // X decrements not 4 cycles after the previous one
+    uint32_t startPushes;       // Pushes before the first edge
+};
+
+static int findLabel(const struct modelProgram *program, const char *name, int mustBePublic) {
+    for (int k = 0; k < program->labelCount; k++) {
+        if (strcmp(program->labels[k], name) == 0 && (program->labelPublic[k] || !mustBePublic)) {
+            return program->labelAddress[k];
+        }
+    }
+
+    return -1;
+}
+
+// Split off the next whitespace or comma separated word
+static char *nextWord(char **text) {
+    while (**text && (isspace((unsigned char)**text) || **text == ',')) {
+        (*text)++;
+    }
+
+    if (**text == '\0') {
+        return NULL;
+    }
+
+    char *word = *text;
+
+    if (*word == '[') {
+        while (**text && **text != ']') {
+            (*text)++;
+        }
+        if (**text) {
+            (*text)++;
+        }
+    }
+    else {
+        while (**text && !isspace((unsigned char)**text) && **text != ',') {
+            (*text)++;
+        }
+    }
+
+    if (**text) {
+        *(*text)++ = '\0';
+    }
+
+    return word;
+}
+
+static int parseDelay(const char *word, int line) {
+    if (word == NULL) {
+        return 0;
+    }
+
+    if (word[0] != '[') {
+        fprintf(stderr, "line %d: unexpected \"%s\"\n", line, word);
+        exit(2);
+    }
+
+    return atoi(word + 1);
+}
+
+// Assemble the first .program in the file
+static void loadProgram(const char *path, struct modelProgram *program) {
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        fprintf(stderr, "%s: cannot read\n", path);
+        exit(2);
+    }
+
+    char buffer[256];
+    int line = 0;
+    memset(program, 0, sizeof(*program));
+
+    while (fgets(buffer, sizeof(buffer), file)) {
+        line++;
+        char *comment = strchr(buffer, ';');
+
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char *text = buffer;
+        char *word = nextWord(&text);
+
+        if (word == NULL || word[0] == '.') {
+            continue;
+        }
+
+        int isPublic = strcmp(word, "public") == 0;
+
+        if (isPublic) {
+            word = nextWord(&text);
+        }
+
+        size_t length = strlen(word);
+
+        if (length > 1 && word[length - 1] == ':') {
+            word[length - 1] = '\0';
+            strncpy(program->labels[program->labelCount], word, 31);
+            program->labelAddress[program->labelCount] = program->length;
+            program->labelPublic[program->labelCount] = isPublic;
+            program->labelCount++;
+            continue;
+        }
+
+        if (program->length == MODEL_MAX_INSTRUCTIONS) {
+            fprintf(stderr, "line %d: program does not fit in instruction memory\n", line);
+            exit(2);
+        }
+
+        struct modelInstruction *instruction = &program->code[program->length++];
+        instruction->line = line;
+
+        if (strcmp(word, "jmp") == 0) {
+            char *first = nextWord(&text);
+            char *second = nextWord(&text);
+
+            instruction->op = OP_JMP;
+            instruction->condition = COND_ALWAYS;
+
+            if (second != NULL && second[0] != '[') {
+                if (strcmp(first, "x--") == 0) {
+                    instruction->condition = COND_X_DEC;
+                }
+                else if (strcmp(first, "pin") == 0) {
+                    instruction->condition = COND_PIN;
+                }
+                else {
+                    fprintf(stderr, "line %d: jmp condition \"%s\" not modelled\n", line, first);
+                    exit(2);
+                }
+                strncpy(instruction->target, second, 31);
+                instruction->delay = parseDelay(nextWord(&text), line);
+            }
+            else {
+                strncpy(instruction->target, first, 31);
+                instruction->delay = parseDelay(second, line);
+            }
+        }
+        else if (strcmp(word, "in") == 0) {
+            char *source = nextWord(&text);
+            char *bits = nextWord(&text);
+
+            if (source == NULL || bits == NULL || strcmp(source, "x") != 0 || atoi(bits) != 32) {
+                fprintf(stderr, "line %d: only \"in x, 32\" is modelled\n", line);
+                exit(2);
+            }
+            instruction->op = OP_IN_X;
+            instruction->delay = parseDelay(nextWord(&text), line);
+        }
+        else {
+            fprintf(stderr, "line %d: instruction \"%s\" not modelled\n", line, word);
+            exit(2);
+        }
+    }
+
+    fclose(file);
+
+    for (int i = 0; i < program->length; i++) {
+        struct modelInstruction *instruction = &program->code[i];
+
+        if (instruction->op == OP_JMP) {
+            instruction->address = findLabel(program, instruction->target, 0);
+
+            if (instruction->address < 0) {
+                fprintf(stderr, "line %d: unknown label \"%s\"\n", instruction->line, instruction->target);
+                exit(2);
+            }
+        }
+    }
+}
+
+// Pin level at a cycle: the start level, toggled by every edge at or before it
+static int pinAt(const uint64_t *edges, uint32_t count, int startLevel, uint64_t cycle, uint32_t *next) {
+    while (*next < count && edges[*next] <= cycle) {
+        (*next)++;
+    }
+
+    return startLevel ^ (*next & 1);
+}
+
+// Run the program from the entry matching startLevel until just after the last edge
+static void runProgram(const struct modelProgram *program, const uint64_t *edges, uint32_t count,
+                       int startLevel, struct modelRun *run) {
+    uint32_t ring[ENCODER_EDGE_RING_SIZE];
+    uint32_t x = 0;             // pio_sm_exec(set x, 0) at start-up
+    uint64_t cycle = 0;
+    uint64_t lastTick = 0;
+    uint32_t ticks = 0;
+    uint32_t nextEdge = 0;
+    int pc = findLabel(program, startLevel ? "high" : "low", 1);
+    uint64_t end = edges[count - 1] + 64 * MODEL_CYCLES_PER_TICK;
+
+    memset(run, 0, sizeof(*run));
+
+    while (cycle < end) {
+        const struct modelInstruction *instruction = &program->code[pc];
+        int pin = pinAt(edges, count, startLevel, cycle, &nextEdge);
+        int next = pc + 1 < program->length ? pc + 1 : 0;   // Default wrap: end back to start
+
+        if (instruction->op == OP_JMP) {
+            int taken = 1;
+
+            if (instruction->condition == COND_X_DEC) {
+                taken = x != 0;
+                x--;
+
+                if (ticks > 0 && cycle - lastTick != MODEL_CYCLES_PER_TICK) {
+                    run->badTicks++;
+                }
+                lastTick = cycle;
+                ticks++;
+            }
+            else if (instruction->condition == COND_PIN) {
+                taken = pin;
+            }
+
+            if (taken) {
+                next = instruction->address;
+            }
+        }
+        else {
+            // in x, 32 with autopush at 32 bits: the word goes straight to the FIFO and DMA
+            uint32_t edge = run->pushes++;
+            ring[edge & ENCODER_EDGE_RING_MASK] = x;
+
+            if (nextEdge == 0) {
+                run->startPushes++;
+            }
+            else if (edge >= count) {
+                run->missed++;
+            }
+            else {
+                // The firmware reads the ring as pioStartUs + ~word; compare in cycles
+                uint64_t pushed = (uint64_t)(~ring[edge & ENCODER_EDGE_RING_MASK]) * MODEL_CYCLES_PER_TICK;
+                uint64_t error = pushed > edges[edge] ? pushed - edges[edge] : edges[edge] - pushed;
+
+                if (error > run->maxErrorQuarterUs) {
+                    run->maxErrorQuarterUs = (uint32_t)error;
+                }
+            }
+        }
+
+        cycle += 1 + instruction->delay;
+        pc = next;
+    }
+
+    if (run->pushes < count) {
+        run->missed += count - run->pushes;
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "hardware_encoder/encoder.pio";
+    struct modelProgram program;
+
+    loadProgram(path, &program);
+
+    // encoder.c starts each state machine at encoder_edge_offset_low or _high
+    if (findLabel(&program, "low", 1) < 0 || findLabel(&program, "high", 1) < 0) {
+        fprintf(stderr, "%s: needs public \"low\" and \"high\" entry points\n", path);
+        return 2;
+    }
+
+    // Edges from a few per second up to the shortest gap the program must resolve
+    static uint64_t edges[MODEL_EDGES];
+    uint64_t cycle = 1000 * MODEL_CYCLES_PER_US;
+    srand(2004);
+
+    for (uint32_t e = 0; e < MODEL_EDGES; e++) {
+        uint32_t gap;
+
+        switch (e % 4) {
+        case 0:
+            gap = MODEL_MIN_GAP_CYCLES + rand() % (4 * MODEL_CYCLES_PER_TICK);
+            break;
+        case 1:
+            gap = rand() % (5000 * MODEL_CYCLES_PER_US);
+            break;
+        default:
+            gap = rand() % (200000 * MODEL_CYCLES_PER_US);
+            break;
+        }
+
+        cycle += gap < MODEL_MIN_GAP_CYCLES ? MODEL_MIN_GAP_CYCLES : gap;
+        edges[e] = cycle;
+    }
+
+    int failed = 0;
+    printf("program:        %s (%d instructions)\n", path, program.length);
+
+    for (int level = 0; level < 2; level++) {
+        struct modelRun run;
+        runProgram(&program, edges, MODEL_EDGES, level, &run);
+
+        int ok = run.missed == 0 && run.badTicks == 0 && run.startPushes == 0 &&
+                 run.maxErrorQuarterUs <= MODEL_CYCLES_PER_TICK;
+        failed |= !ok;
+
+        printf("start %-5s     %u edges, %u pushes, %u missed, %u start-up pushes, "
+               "max error %.2f us, %u uneven ticks%s\n",
+               level ? "high:" : "low:", MODEL_EDGES, run.pushes, run.missed, run.startPushes,
+               (double)run.maxErrorQuarterUs / MODEL_CYCLES_PER_US, run.badTicks, ok ? "" : "  FAIL");
+    }
+
+    printf("CPU interrupts: 0 per revolution (%d edges moved by DMA)\n", NOTCHES_PER_CYCLE);
+
+    return failed;
+}
+
+/*** End of file ***/
@@ -0,0 +1,28 @@
+/**
+ * @file gpio.h
+ *
+ * @brief Stand-in for the Pico SDK's hardware/gpio.h for host tools.
+ *
+ * Pin setup does nothing on the host; the tool drives the firmware's edge
+ * handlers itself.
+ *
+ */
+
+#ifndef _HOST_HARDWARE_GPIO_H
+#define _HOST_HARDWARE_GPIO_H
+
+#define GPIO_IN 0
+#define GPIO_OUT 1
+
+static inline void gpio_init(unsigned int gpio) {
+    (void)gpio;
+}
+
+static inline void gpio_set_dir(unsigned int gpio, int out) {
+    (void)gpio;
+    (void)out;
+}
+
+#endif
+
+/*** End of file ***/
@@ -0,0 +1,27 @@
+/**
+ * @file stdlib.h
+ *
+ * @brief Minimal stand-in for the Pico SDK's pico/stdlib.h for host tools.
+ *
+ * Lets firmware sources that only need the timer be compiled on a desktop machine
+ * with -Itools/host. The tool that links them provides the time functions, so it
+ * controls the clock the firmware sees.
+ *
+ */
+
+#ifndef _HOST_PICO_STDLIB_H
+#define _HOST_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+
+#define __compiler_memory_barrier() __asm__ volatile ("" : : : "memory")
+
+#endif
+
+/*** End of file ***/